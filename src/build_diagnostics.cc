@@ -0,0 +1,300 @@
+#include "build_diagnostics.h"
+#include "filesystem.h"
+#include "source.h"
+#include <algorithm>
+#include <cstring>
+
+std::string BuildDiagnostics::Diagnostic::severity_string() const {
+  if(severity==Severity::ERROR)
+    return "error";
+  if(severity==Severity::WARNING)
+    return "warning";
+  return "note";
+}
+
+std::vector<BuildDiagnostics::Diagnostic> BuildDiagnostics::Parser::parse(const char *bytes, size_t n) {
+  std::vector<Diagnostic> diagnostics;
+  auto end=bytes+n;
+  for(;;) {
+    auto line_end=static_cast<const char *>(std::memchr(bytes, '\n', end-bytes));
+    if(!line_end) {
+      incomplete_line.append(bytes, end);
+      break;
+    }
+    if(incomplete_line.empty())
+      parse_line(std::string(bytes, line_end), diagnostics);
+    else {
+      incomplete_line.append(bytes, line_end);
+      parse_line(incomplete_line, diagnostics);
+      incomplete_line.clear();
+    }
+    bytes=line_end+1;
+  }
+  return diagnostics;
+}
+
+std::vector<BuildDiagnostics::Diagnostic> BuildDiagnostics::Parser::finish() {
+  std::vector<Diagnostic> diagnostics;
+  if(!incomplete_line.empty()) {
+    parse_line(incomplete_line, diagnostics);
+    incomplete_line.clear();
+  }
+  include_chain.clear();
+  return diagnostics;
+}
+
+void BuildDiagnostics::Parser::parse_line(const std::string &line_, std::vector<Diagnostic> &diagnostics) {
+  auto previous_line_included=last_line_included;
+  last_line_included=false;
+  
+  // Build progress, for instance: [3/10] Building CXX object a.cc.o, or: [ 30%] Building CXX object a.cc.o
+  if(line_.size()>3 && line_[0]=='[') {
+    size_t pos=1;
+    while(pos<line_.size() && line_[pos]==' ')
+      ++pos;
+    auto parse_number=[&line_](size_t &pos, size_t &number) {
+      auto start=pos;
+      number=0;
+      while(pos<line_.size() && line_[pos]>='0' && line_[pos]<='9')
+        number=number*10+(line_[pos++]-'0');
+      return pos>start;
+    };
+    size_t done, total;
+    if(parse_number(pos, done) && pos+1<line_.size()) {
+      if(line_[pos]=='/') {
+        ++pos;
+        if(parse_number(pos, total) && pos<line_.size() && line_[pos]==']' && total>0 && done<=total) {
+          progress=static_cast<double>(done)/total;
+          return;
+        }
+      }
+      else if(line_[pos]=='%' && line_[pos+1]==']' && done<=100) {
+        progress=static_cast<double>(done)/100.0;
+        return;
+      }
+    }
+  }
+  
+  // Quick rejection of lines that cannot contain a location
+  if(line_.size()<4 || line_.find(':')==std::string::npos)
+    return;
+  
+  const std::string *line_ptr=&line_;
+  std::string line_without_colors;
+  if(line_.find('\e')!=std::string::npos) {
+    line_without_colors.reserve(line_.size());
+    for(size_t i=0;i<line_.size();++i) {
+      if(line_[i]=='\e' && i+1<line_.size() && line_[i+1]=='[') {
+        i+=2;
+        while(i<line_.size() && ((line_[i]>='0' && line_[i]<='9') || line_[i]==';'))
+          ++i;
+        if(i<line_.size() && line_[i]!='m')
+          line_without_colors+=line_[i];
+      }
+      else
+        line_without_colors+=line_[i];
+    }
+    line_ptr=&line_without_colors;
+  }
+  auto &line=*line_ptr;
+  auto size=line.size();
+  if(size>0 && line[size-1]=='\r')
+    --size;
+  
+  auto starts_with=[&line, &size](size_t pos, const char *text) {
+    auto text_size=std::strlen(text);
+    return pos+text_size<=size && line.compare(pos, text_size, text)==0;
+  };
+  auto parse_number=[&line, &size](size_t &pos, int &number) {
+    auto start=pos;
+    number=0;
+    while(pos<size && line[pos]>='0' && line[pos]<='9')
+      number=number*10+(line[pos++]-'0');
+    return pos>start;
+  };
+  // Parses <path>:<line>[:<column>] at pos, where path must not contain ':' apart from a drive letter
+  auto parse_location=[&](size_t &pos, std::string &path, int &line_nr, int &index) {
+    auto path_start=pos;
+    if(pos+1<size && line[pos]>='A' && line[pos]<='Z' && line[pos+1]==':')
+      pos+=2;
+    auto path_end=line.find(':', pos);
+    if(path_end==std::string::npos || path_end==pos || path_end>=size)
+      return false;
+    pos=path_end+1;
+    if(!parse_number(pos, line_nr))
+      return false;
+    index=1;
+    if(pos+1<size && line[pos]==':' && line[pos+1]>='0' && line[pos+1]<='9') {
+      ++pos;
+      parse_number(pos, index);
+    }
+    path=line.substr(path_start, path_end-path_start);
+    return true;
+  };
+  
+  std::string path;
+  int line_nr, index;
+  
+  // Include chain from gcc: In file included from a.h:1,
+  //                                           from a.cc:2:
+  // or from clang, outermost include first: In file included from a.cc:2:
+  //                                         In file included from a.h:1:
+  size_t pos=0;
+  if(starts_with(0, "In file included from "))
+    pos=22;
+  else {
+    while(pos<size && line[pos]==' ')
+      ++pos;
+    if(pos>0 && starts_with(pos, "from "))
+      pos+=5;
+    else
+      pos=0;
+  }
+  if(pos>0) {
+    if(parse_location(pos, path, line_nr, index) && pos+1==size && (line[pos]==':' || line[pos]==',')) {
+      if(line[0]!='I')
+        include_chain.emplace_back(get_path(path), line_nr);
+      else {
+        if(!previous_line_included)
+          include_chain.clear();
+        include_chain.emplace(include_chain.begin(), get_path(path), line_nr);
+      }
+      last_line_included=true;
+    }
+    return;
+  }
+  
+  // Diagnostic, for instance: a.cc:1:2: error: message
+  if(!parse_location(pos, path, line_nr, index) || !starts_with(pos, ": "))
+    return;
+  pos+=2;
+  Diagnostic::Severity severity;
+  if(starts_with(pos, "error: ")) {
+    severity=Diagnostic::Severity::ERROR;
+    pos+=7;
+  }
+  else if(starts_with(pos, "fatal error: ")) {
+    severity=Diagnostic::Severity::ERROR;
+    pos+=13;
+  }
+  else if(starts_with(pos, "warning: ")) {
+    severity=Diagnostic::Severity::WARNING;
+    pos+=9;
+  }
+  else if(starts_with(pos, "note: ")) {
+    severity=Diagnostic::Severity::NOTE;
+    pos+=6;
+  }
+  else
+    return;
+  
+  Diagnostic diagnostic;
+  diagnostic.path=get_path(path);
+  diagnostic.line=line_nr;
+  diagnostic.index=index;
+  diagnostic.severity=severity;
+  diagnostic.message=line.substr(pos, size-pos);
+  if(severity!=Diagnostic::Severity::NOTE) {
+    diagnostic.include_chain=std::move(include_chain);
+    include_chain.clear();
+  }
+  diagnostics.emplace_back(std::move(diagnostic));
+}
+
+boost::filesystem::path BuildDiagnostics::Parser::get_path(const std::string &path) {
+  boost::filesystem::path result(path);
+  if(result.is_relative() && !directory.empty())
+    result=directory/result;
+  return filesystem::get_normal_path(result);
+}
+
+size_t BuildDiagnostics::DiagnosticHash::operator()(const Diagnostic &diagnostic) const {
+  auto hash=std::hash<std::string>()(diagnostic.path.string());
+  hash^=std::hash<std::string>()(diagnostic.message)+0x9e3779b9+(hash<<6)+(hash>>2);
+  return hash^(static_cast<size_t>(diagnostic.line)<<8)^static_cast<size_t>(diagnostic.index);
+}
+
+void BuildDiagnostics::add(std::vector<Diagnostic> &&new_diagnostics) {
+  for(auto &diagnostic: new_diagnostics) {
+    if(!diagnostics_set.emplace(diagnostic).second)
+      continue;
+    if(diagnostic.severity==Diagnostic::Severity::ERROR)
+      ++error_count;
+    else if(diagnostic.severity==Diagnostic::Severity::WARNING)
+      ++warning_count;
+    diagnostics.emplace_back(std::move(diagnostic));
+    if(on_add)
+      on_add(diagnostics.back());
+  }
+}
+
+void BuildDiagnostics::clear() {
+  diagnostics.clear();
+  diagnostics_set.clear();
+  checked_files.clear();
+  warning_count=0;
+  error_count=0;
+  if(on_clear)
+    on_clear();
+  set_progress(-1.0);
+}
+
+void BuildDiagnostics::set_progress(double progress_) {
+  if(progress_==progress)
+    return;
+  progress=progress_;
+  if(on_progress)
+    on_progress();
+}
+
+void BuildDiagnostics::begin_file_check(const boost::filesystem::path &file_path) {
+  checked_files.emplace(file_path.string());
+  
+  auto it=std::stable_partition(diagnostics.begin(), diagnostics.end(), [&file_path](const Diagnostic &diagnostic) {
+    return diagnostic.path!=file_path;
+  });
+  for(auto erase_it=it;erase_it!=diagnostics.end();++erase_it) {
+    diagnostics_set.erase(*erase_it);
+    if(erase_it->severity==Diagnostic::Severity::ERROR)
+      --error_count;
+    else if(erase_it->severity==Diagnostic::Severity::WARNING)
+      --warning_count;
+  }
+  diagnostics.erase(it, diagnostics.end());
+  
+  for(auto &view: Source::View::views) {
+    if(view->file_path==file_path)
+      view->clear_diagnostic_tooltips();
+  }
+}
+
+void BuildDiagnostics::add_markers(Source::View *view) {
+  for(auto &diagnostic: diagnostics) {
+    if(diagnostic.path==view->file_path)
+      add_marker(view, diagnostic);
+  }
+}
+
+void BuildDiagnostics::add_marker(Source::View *view, const Diagnostic &diagnostic) {
+  if(diagnostic.severity==Diagnostic::Severity::NOTE || diagnostic.path!=view->file_path)
+    return;
+  if(view->goto_next_diagnostic && checked_files.count(view->file_path.string())==0)
+    return;
+  if(diagnostic.line<1 || diagnostic.line>view->get_buffer()->get_line_count())
+    return;
+  
+  auto start=view->get_iter_at_line_index(diagnostic.line-1, diagnostic.index-1);
+  auto end=start;
+  auto is_token_char=[](gunichar chr) {
+    return (chr>='a' && chr<='z') || (chr>='A' && chr<='Z') || (chr>='0' && chr<='9') || chr=='_' || chr>=128;
+  };
+  while(!end.ends_line() && is_token_char(*end))
+    end.forward_char();
+  if(end==start && !end.ends_line())
+    end.forward_char();
+  
+  auto message=diagnostic.message;
+  for(auto &include: diagnostic.include_chain)
+    message+="\nIncluded from "+filesystem::get_short_path(include.first).string()+':'+std::to_string(include.second);
+  view->add_diagnostic_tooltip(start, end, std::move(message), diagnostic.severity==Diagnostic::Severity::ERROR);
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <boost/filesystem.hpp>
+#include <functional>
+#include <string>
+#include <tuple>
+#include <unordered_set>
+#include <vector>
+
+namespace Source {
+  class View;
+}
+
+/// Diagnostics parsed from compiler output in the terminal
+class BuildDiagnostics {
+public:
+  class Diagnostic {
+  public:
+    enum class Severity { NOTE, WARNING, ERROR };
+    
+    boost::filesystem::path path;
+    /// 1-based line and byte index
+    int line, index;
+    Severity severity;
+    std::string message;
+    /// Include locations leading to path, with the location closest to path first
+    std::vector<std::pair<boost::filesystem::path, int>> include_chain;
+    
+    std::string severity_string() const;
+    bool operator==(const Diagnostic &rhs) const {
+      return std::tie(path, line, index, severity, message)==std::tie(rhs.path, rhs.line, rhs.index, rhs.severity, rhs.message);
+    }
+  };
+  
+  /// Parses output of a single stream incrementally, where lines can be split between chunks
+  class Parser {
+  public:
+    /// Relative paths in the output are resolved from directory
+    Parser(boost::filesystem::path directory) : directory(std::move(directory)) {}
+    /// Returns the diagnostics found in the lines completed by bytes
+    std::vector<Diagnostic> parse(const char *bytes, size_t n);
+    /// Parses the remaining incomplete line
+    std::vector<Diagnostic> finish();
+    
+    /// Fraction of the build done according to the last progress line, for instance [3/10] from Ninja or [ 30%] from Make,
+    /// or negative if no progress line has been found
+    double progress=-1.0;
+  
+  private:
+    boost::filesystem::path directory;
+    std::string incomplete_line;
+    std::vector<std::pair<boost::filesystem::path, int>> include_chain;
+    bool last_line_included=false;
+    
+    void parse_line(const std::string &line, std::vector<Diagnostic> &diagnostics);
+    boost::filesystem::path get_path(const std::string &path);
+  };
+
+private:
+  BuildDiagnostics() = default;
+  
+  class DiagnosticHash {
+  public:
+    size_t operator()(const Diagnostic &diagnostic) const;
+  };
+  std::unordered_set<Diagnostic, DiagnosticHash> diagnostics_set;
+  /// Files checked with begin_file_check() since the last clear()
+  std::unordered_set<std::string> checked_files;
+
+public:
+  static BuildDiagnostics &get() {
+    static BuildDiagnostics singleton;
+    return singleton;
+  }
+  
+  /// Diagnostics in the order they were found
+  std::vector<Diagnostic> diagnostics;
+  size_t warning_count=0, error_count=0;
+  /// Build progress from the last progress line in the output, or negative if unknown
+  double progress=-1.0;
+  
+  /// Must be called from the main thread. Diagnostics already found are ignored.
+  void add(std::vector<Diagnostic> &&new_diagnostics);
+  void clear();
+  /// Must be called from the main thread
+  void set_progress(double progress);
+  /// Called before compiling a single file. Removes the diagnostics of the file, and clears the diagnostics of its views,
+  /// which will show the diagnostics found from now on even if they have diagnostics of their own.
+  void begin_file_check(const boost::filesystem::path &file_path);
+  
+  /// Called with each new diagnostic
+  std::function<void(const Diagnostic &diagnostic)> on_add;
+  std::function<void()> on_clear;
+  std::function<void()> on_progress;
+  
+  /// Underlines the diagnostics of view's file, unless view shows diagnostics of its own and the file has not been checked
+  void add_markers(Source::View *view);
+  void add_marker(Source::View *view, const Diagnostic &diagnostic);
+};
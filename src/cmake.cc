@@ -5,6 +5,10 @@
 #include "terminal.h"
 #include <regex>
 #include "compile_commands.h"
+#include <boost/property_tree/json_parser.hpp>
+
+std::unordered_map<std::string, std::pair<boost::filesystem::path, std::shared_ptr<CMake::CodeModel>>> CMake::code_models;
+std::mutex CMake::code_models_mutex;
 
 CMake::CMake(const boost::filesystem::path &path) {
   const auto find_cmake_project=[](const boost::filesystem::path &cmake_path) {
@@ -33,75 +37,114 @@ CMake::CMake(const boost::filesystem::path &path) {
   }
 }
 
-bool CMake::update_default_build(const boost::filesystem::path &default_build_path, bool force) {
-  if(project_path.empty() || !boost::filesystem::exists(project_path/"CMakeLists.txt") || default_build_path.empty())
+bool CMake::update_default_build(const boost::filesystem::path &default_build_path, bool force, const std::function<void(int exit_status)> &on_exit) {
+  auto failed=[&on_exit] {
+    if(on_exit)
+      on_exit(-1);
     return false;
+  };
+  
+  if(project_path.empty() || !boost::filesystem::exists(project_path/"CMakeLists.txt") || default_build_path.empty())
+    return failed();
   
   if(!boost::filesystem::exists(default_build_path)) {
     boost::system::error_code ec;
     boost::filesystem::create_directories(default_build_path, ec);
     if(ec) {
       Terminal::get().print("Error: could not create "+default_build_path.string()+": "+ec.message()+"\n", true);
-      return false;
+      return failed();
     }
   }
   
+  // Configure existing builds once more to get a File API reply
+  if(create_file_api_query(default_build_path))
+    force=true;
+  
   if(!force && boost::filesystem::exists(default_build_path/"compile_commands.json"))
     return true;
   
-  auto compile_commands_path=default_build_path/"compile_commands.json";
+  auto command=Config::get().project.cmake.command+' '+filesystem::escape_argument(project_path.string())+" -DCMAKE_EXPORT_COMPILE_COMMANDS=ON";
+  if(on_exit) {
+    Terminal::get().print("Creating/updating default build in "+filesystem::get_short_path(default_build_path).string()+"\n");
+    Terminal::get().async_process(command, default_build_path, [default_build_path, on_exit](int exit_status) {
+      if(exit_status==EXIT_SUCCESS)
+        fix_compile_commands(default_build_path);
+      on_exit(exit_status);
+    }, false, true);
+    return false;
+  }
+  
   Dialog::Message message("Creating/updating default build");
-  auto exit_status=Terminal::get().process(Config::get().project.cmake.command+' '+
-                                           filesystem::escape_argument(project_path.string())+" -DCMAKE_EXPORT_COMPILE_COMMANDS=ON", default_build_path);
+  auto exit_status=Terminal::get().process(command, default_build_path);
   message.hide();
   if(exit_status==EXIT_SUCCESS) {
-#ifdef _WIN32 //Temporary fix to MSYS2's libclang
-    auto compile_commands_file=filesystem::read(compile_commands_path);
-    auto replace_drive = [&compile_commands_file](const std::string& param) {
-      size_t pos=0;
-      auto param_size = param.length();
-      while((pos=compile_commands_file.find(param+"/", pos))!=std::string::npos) {
-        if(pos+param_size+1<compile_commands_file.size())
-          compile_commands_file.replace(pos, param_size+2, param+compile_commands_file[pos+param_size+1]+":");
-        else
-          break;
-      }
-    };
-    replace_drive("-I");
-    replace_drive("-isystem ");
-    filesystem::write(compile_commands_path, compile_commands_file);
-#endif
+    fix_compile_commands(default_build_path);
     return true;
   }
   return false;
 }
 
-bool CMake::update_debug_build(const boost::filesystem::path &debug_build_path, bool force) {
-  if(project_path.empty() || !boost::filesystem::exists(project_path/"CMakeLists.txt") || debug_build_path.empty())
+bool CMake::update_debug_build(const boost::filesystem::path &debug_build_path, bool force, const std::function<void(int exit_status)> &on_exit) {
+  auto failed=[&on_exit] {
+    if(on_exit)
+      on_exit(-1);
     return false;
+  };
+  
+  if(project_path.empty() || !boost::filesystem::exists(project_path/"CMakeLists.txt") || debug_build_path.empty())
+    return failed();
   
   if(!boost::filesystem::exists(debug_build_path)) {
     boost::system::error_code ec;
     boost::filesystem::create_directories(debug_build_path, ec);
     if(ec) {
       Terminal::get().print("Error: could not create "+debug_build_path.string()+": "+ec.message()+"\n", true);
-      return false;
+      return failed();
     }
   }
   
   if(!force && boost::filesystem::exists(debug_build_path/"CMakeCache.txt"))
     return true;
   
+  auto command=Config::get().project.cmake.command+' '+filesystem::escape_argument(project_path.string())+" -DCMAKE_BUILD_TYPE=Debug";
+  if(on_exit) {
+    Terminal::get().print("Creating/updating debug build in "+filesystem::get_short_path(debug_build_path).string()+"\n");
+    Terminal::get().async_process(command, debug_build_path, on_exit, false, true);
+    return false;
+  }
+  
   Dialog::Message message("Creating/updating debug build");
-  auto exit_status=Terminal::get().process(Config::get().project.cmake.command+' '+
-                                           filesystem::escape_argument(project_path.string())+" -DCMAKE_BUILD_TYPE=Debug", debug_build_path);
+  auto exit_status=Terminal::get().process(command, debug_build_path);
   message.hide();
   if(exit_status==EXIT_SUCCESS)
     return true;
   return false;
 }
 
+void CMake::fix_compile_commands(const boost::filesystem::path &build_path) {
+#ifdef _WIN32 //Temporary fix to MSYS2's libclang
+  auto compile_commands_path=build_path/"compile_commands.json";
+  auto compile_commands_file=filesystem::read(compile_commands_path);
+  auto replace_drive = [&compile_commands_file](const std::string& param) {
+    size_t pos=0;
+    auto param_size = param.length();
+    while((pos=compile_commands_file.find(param+"/", pos))!=std::string::npos) {
+      if(pos+param_size+1<compile_commands_file.size())
+        compile_commands_file.replace(pos, param_size+2, param+compile_commands_file[pos+param_size+1]+":");
+      else
+        break;
+    }
+  };
+  replace_drive("-I");
+  replace_drive("-isystem ");
+  filesystem::write(compile_commands_path, compile_commands_file);
+#endif
+}
+
 boost::filesystem::path CMake::get_executable(const boost::filesystem::path &build_path, const boost::filesystem::path &file_path) {
+  if(auto code_model=get_code_model(build_path))
+    return code_model->find(file_path);
+  
   // CMake does not store in compile_commands.json if an object is part of an executable or not.
   // Therefore, executables are first attempted found in the cmake files. These executables
   // are then used to identify if a file in compile_commands.json is part of an executable or not
@@ -136,45 +179,96 @@ boost::filesystem::path CMake::get_executable(const boost::filesystem::path &bui
     }
   }
   
-  size_t best_match_size=-1;
-  boost::filesystem::path best_match_executable;
-  
+  SourceExecutables source_executables;
   for(auto &cmake_executable: cmake_executables) {
     for(auto &command_file_and_maybe_executable: command_files_and_maybe_executables) {
-      auto &command_file=command_file_and_maybe_executable.first;
-      auto &maybe_executable=command_file_and_maybe_executable.second;
-      if(cmake_executable==maybe_executable) {
-        if(command_file==file_path)
-          return maybe_executable;
-        auto command_file_directory=command_file.parent_path();
-        if(filesystem::file_in_path(file_path, command_file_directory)) {
-          auto size=static_cast<size_t>(std::distance(command_file_directory.begin(), command_file_directory.end()));
-          if(best_match_size==static_cast<size_t>(-1) || best_match_size<size) {
-            best_match_size=size;
-            best_match_executable=maybe_executable;
-          }
-        }
-      }
+      if(cmake_executable==command_file_and_maybe_executable.second)
+        source_executables.add(command_file_and_maybe_executable.first, command_file_and_maybe_executable.second);
     }
   }
-  if(!best_match_executable.empty())
-    return best_match_executable;
+  auto executable=source_executables.find(file_path);
+  if(!executable.empty())
+    return executable;
   
-  for(auto &command_file_and_maybe_executable: command_files_and_maybe_executables) {
-    auto &command_file=command_file_and_maybe_executable.first;
-    auto &maybe_executable=command_file_and_maybe_executable.second;
-    if(command_file==file_path)
-      return maybe_executable;
-    auto command_file_directory=command_file.parent_path();
-    if(filesystem::file_in_path(file_path, command_file_directory)) {
-      auto size=static_cast<size_t>(std::distance(command_file_directory.begin(), command_file_directory.end()));
-      if(best_match_size==static_cast<size_t>(-1) || best_match_size<size) {
-        best_match_size=size;
-        best_match_executable=maybe_executable;
+  SourceExecutables maybe_source_executables;
+  for(auto &command_file_and_maybe_executable: command_files_and_maybe_executables)
+    maybe_source_executables.add(command_file_and_maybe_executable.first, command_file_and_maybe_executable.second);
+  return maybe_source_executables.find(file_path);
+}
+
+bool CMake::create_file_api_query(const boost::filesystem::path &build_path) {
+  auto query_path=build_path/".cmake"/"api"/"v1"/"query";
+  if(boost::filesystem::exists(query_path/"codemodel-v2"))
+    return false;
+  boost::system::error_code ec;
+  boost::filesystem::create_directories(query_path, ec);
+  if(ec)
+    return false;
+  return filesystem::write(query_path/"codemodel-v2");
+}
+
+std::shared_ptr<CMake::CodeModel> CMake::get_code_model(const boost::filesystem::path &build_path) {
+  // The reply index file with the lexicographically largest name is the most recent
+  boost::filesystem::path index_path;
+  boost::system::error_code ec;
+  for(boost::filesystem::directory_iterator it(build_path/".cmake"/"api"/"v1"/"reply", ec), end;!ec && it!=end;it.increment(ec)) {
+    auto filename=it->path().filename().string();
+    if(filename.compare(0, 6, "index-")==0 && it->path().extension()==".json" && (index_path.empty() || filename>index_path.filename().string()))
+      index_path=it->path();
+  }
+  if(index_path.empty())
+    return nullptr;
+  
+  std::unique_lock<std::mutex> lock(code_models_mutex);
+  auto it=code_models.find(build_path.string());
+  if(it!=code_models.end() && it->second.first==index_path)
+    return it->second.second;
+  lock.unlock();
+  
+  auto code_model=std::make_shared<CodeModel>();
+  try {
+    auto reply_path=index_path.parent_path();
+    boost::property_tree::ptree index_pt;
+    boost::property_tree::json_parser::read_json(index_path.string(), index_pt);
+    auto codemodel_file=index_pt.get_child("reply").get_child("codemodel-v2").get<std::string>("jsonFile");
+    
+    boost::property_tree::ptree codemodel_pt;
+    boost::property_tree::json_parser::read_json((reply_path/codemodel_file).string(), codemodel_pt);
+    boost::filesystem::path source_path=codemodel_pt.get<std::string>("paths.source");
+    boost::filesystem::path artifact_path=codemodel_pt.get<std::string>("paths.build");
+    auto configurations_pt=codemodel_pt.get_child("configurations");
+    if(configurations_pt.empty())
+      return nullptr;
+    for(auto &target: configurations_pt.begin()->second.get_child("targets")) {
+      boost::property_tree::ptree target_pt;
+      boost::property_tree::json_parser::read_json((reply_path/target.second.get<std::string>("jsonFile")).string(), target_pt);
+      if(target_pt.get<std::string>("type")!="EXECUTABLE")
+        continue;
+      auto artifacts_pt=target_pt.get_child("artifacts", boost::property_tree::ptree());
+      if(artifacts_pt.empty())
+        continue;
+      boost::filesystem::path executable=artifacts_pt.begin()->second.get<std::string>("path");
+      if(executable.is_relative())
+        executable=artifact_path/executable;
+      executable=filesystem::get_normal_path(executable);
+      code_model->target_names_by_executable.emplace(executable.string(), target_pt.get<std::string>("name"));
+      
+      for(auto &source: target_pt.get_child("sources", boost::property_tree::ptree())) {
+        boost::filesystem::path source_file=source.second.get<std::string>("path");
+        if(source_file.is_relative())
+          source_file=source_path/source_file;
+        source_file=filesystem::get_normal_path(source_file);
+        code_model->add(std::move(source_file), executable);
       }
     }
   }
-  return best_match_executable;
+  catch(...) {
+    return nullptr;
+  }
+  
+  lock.lock();
+  code_models[build_path.string()]={index_path, code_model};
+  return code_model;
 }
 
 void CMake::read_files() {
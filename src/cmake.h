@@ -1,5 +1,9 @@
 #pragma once
+#include "compile_commands.h"
 #include <boost/filesystem.hpp>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
@@ -9,12 +13,31 @@ public:
   CMake(const boost::filesystem::path &path);
   boost::filesystem::path project_path;
   
-  bool update_default_build(const boost::filesystem::path &default_build_path, bool force=false);
-  bool update_debug_build(const boost::filesystem::path &debug_build_path, bool force=false);
+  /// Returns true if the build is up to date after the call. If on_exit is set, CMake is run in the background instead of
+  /// behind a modal dialog, and on_exit is called with its exit status unless the build was already up to date.
+  bool update_default_build(const boost::filesystem::path &default_build_path, bool force=false, const std::function<void(int exit_status)> &on_exit=nullptr);
+  bool update_debug_build(const boost::filesystem::path &debug_build_path, bool force=false, const std::function<void(int exit_status)> &on_exit=nullptr);
   
   boost::filesystem::path get_executable(const boost::filesystem::path &build_path, const boost::filesystem::path &file_path);
   
+  /// Requests a codemodel from the CMake File API at the next configure. Returns false if the query already existed.
+  static bool create_file_api_query(const boost::filesystem::path &build_path);
+  
+  /// Executables and their source files from the CMake File API reply in a build directory
+  class CodeModel : public SourceExecutables {
+  public:
+    std::unordered_map<std::string, std::string> target_names_by_executable;
+  };
+  /// Returns nullptr if build_path has no File API reply. The reply is read once per configure.
+  static std::shared_ptr<CodeModel> get_code_model(const boost::filesystem::path &build_path);
+  
 private:
+  /// Code models and their reply index files, by build path
+  static std::unordered_map<std::string, std::pair<boost::filesystem::path, std::shared_ptr<CodeModel>>> code_models;
+  static std::mutex code_models_mutex;
+  
+  static void fix_compile_commands(const boost::filesystem::path &build_path);
+
   std::vector<boost::filesystem::path> paths;
   std::vector<std::string> files;
   std::unordered_map<std::string, std::string> variables;
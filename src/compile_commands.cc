@@ -1,5 +1,6 @@
 #include "compile_commands.h"
 #include "clangmm.h"
+#include "filesystem.h"
 #include <boost/property_tree/json_parser.hpp>
 #include <regex>
 
@@ -19,6 +20,31 @@ std::vector<std::string> CompileCommands::Command::parameter_values(const std::s
   return parameter_values;
 }
 
+std::string CompileCommands::Command::get_file_command(bool syntax_only) const {
+  std::string command;
+  bool ignore_next=false;
+  for(auto &parameter: parameters) {
+    if(ignore_next) {
+      ignore_next=false;
+      continue;
+    }
+    if(syntax_only) {
+      if(parameter=="-o" || parameter=="-MF" || parameter=="-MT" || parameter=="-MQ") {
+        ignore_next=true;
+        continue;
+      }
+      if(parameter=="-c" || parameter=="-MD" || parameter=="-MMD")
+        continue;
+    }
+    if(!command.empty())
+      command+=' ';
+    command+=filesystem::escape_argument(parameter);
+  }
+  if(syntax_only)
+    command+=" -fsyntax-only";
+  return command;
+}
+
 CompileCommands::CompileCommands(const boost::filesystem::path &build_path) {
   try {
     boost::property_tree::ptree root_pt;
@@ -162,3 +188,29 @@ std::vector<std::string> CompileCommands::get_arguments(const boost::filesystem:
 
   return arguments;
 }
+
+void SourceExecutables::add(boost::filesystem::path source_file, const boost::filesystem::path &executable) {
+  executables_by_source.emplace(source_file.string(), executable);
+  sources_and_executables.emplace_back(std::move(source_file), executable);
+}
+
+boost::filesystem::path SourceExecutables::find(const boost::filesystem::path &file_path) const {
+  auto it=executables_by_source.find(file_path.string());
+  if(it!=executables_by_source.end())
+    return it->second;
+  
+  // Use the executable with source files in the directory closest to file_path
+  size_t best_match_size=-1;
+  boost::filesystem::path best_match_executable;
+  for(auto &source_and_executable: sources_and_executables) {
+    auto source_directory=source_and_executable.first.parent_path();
+    if(filesystem::file_in_path(file_path, source_directory)) {
+      auto size=static_cast<size_t>(std::distance(source_directory.begin(), source_directory.end()));
+      if(best_match_size==static_cast<size_t>(-1) || best_match_size<size) {
+        best_match_size=size;
+        best_match_executable=source_and_executable.second;
+      }
+    }
+  }
+  return best_match_executable;
+}
@@ -2,6 +2,7 @@
 #include <boost/filesystem.hpp>
 #include <vector>
 #include <string>
+#include <unordered_map>
 
 class CompileCommands {
 public:
@@ -12,6 +13,9 @@ public:
     boost::filesystem::path file;
     
     std::vector<std::string> parameter_values(const std::string &parameter_name) const;
+    /// Returns the command that only checks the syntax of file if syntax_only is true, and otherwise the command that compiles file.
+    /// The syntax check writes no output or dependency files.
+    std::string get_file_command(bool syntax_only) const;
   };
   
   CompileCommands(const boost::filesystem::path &build_path);
@@ -20,3 +24,16 @@ public:
   /// Return arguments for the given file using libclangmm
   static std::vector<std::string> get_arguments(const boost::filesystem::path &build_path, const boost::filesystem::path &file_path);
 };
+
+/// Executables and their source files, as found in the data a build system writes to a build directory
+class SourceExecutables {
+public:
+  std::unordered_map<std::string, boost::filesystem::path> executables_by_source;
+  std::vector<std::pair<boost::filesystem::path, boost::filesystem::path>> sources_and_executables;
+  
+  /// Source files that are part of several executables are kept for the first one added
+  void add(boost::filesystem::path source_file, const boost::filesystem::path &executable);
+  /// Returns the executable of file_path, or if not found, the executable with source files in the directory closest to file_path.
+  /// Returns an empty path if no source files are in file_path or its parent directories.
+  boost::filesystem::path find(const boost::filesystem::path &file_path) const;
+};
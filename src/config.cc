@@ -194,11 +194,14 @@ void Config::read(const boost::property_tree::ptree &cfg) {
   project.cmake.compile_command=cfg.get<std::string>("project.cmake.compile_command");
   project.meson.command=cfg.get<std::string>("project.meson.command");
   project.meson.compile_command=cfg.get<std::string>("project.meson.compile_command");
+  project.build_jobs=cfg.get<int>("project.build_jobs");
   project.save_on_compile_or_run=cfg.get<bool>("project.save_on_compile_or_run");
   project.clear_terminal_on_compile=cfg.get<bool>("project.clear_terminal_on_compile");
   project.ctags_command=cfg.get<std::string>("project.ctags_command");
   project.python_command=cfg.get<std::string>("project.python_command");
   
   terminal.history_size=cfg.get<int>("terminal.history_size");
+  terminal.scrollback_size=cfg.get<int>("terminal.scrollback_size");
   terminal.font=cfg.get<std::string>("terminal.font");
+  terminal.output_rate_limit=cfg.get<int>("terminal.output_rate_limit");
 }
@@ -24,7 +24,9 @@ public:
   class Terminal {
   public:
     int history_size;
+    int scrollback_size;
     std::string font;
+    int output_rate_limit;
   };
   
   class Project {
@@ -44,6 +46,7 @@ public:
     std::string debug_build_path;
     CMake cmake;
     Meson meson;
+    int build_jobs;
     bool save_on_compile_or_run;
     bool clear_terminal_on_compile;
     std::string ctags_command;
@@ -4,7 +4,9 @@
 #include "terminal.h"
 #include "notebook.h"
 #include "filesystem.h"
+#include "project_build.h"
 #include "entrybox.h"
+#include "source_language_protocol.h"
 
 bool Directories::TreeStore::row_drop_possible_vfunc(const Gtk::TreeModel::Path &path, const Gtk::SelectionData &selection_data) const {
   return true;
@@ -111,6 +113,9 @@ Directories::Directories() : Gtk::ListViewText(1) {
   
   get_column(0)->set_title("");
   
+  // The language definitions are loaded here, since languages are guessed in the directory reading threads
+  Source::LanguageManager::get_default()->get_language_ids();
+  
   auto renderer=dynamic_cast<Gtk::CellRendererText*>(get_column(0)->get_first_cell());
   get_column(0)->set_cell_data_func(*renderer, [this] (Gtk::CellRenderer *renderer, const Gtk::TreeModel::iterator &iter) {
     if(auto renderer_text=dynamic_cast<Gtk::CellRendererText*>(renderer))
@@ -363,6 +368,7 @@ Directories::Directories() : Gtk::ListViewText(1) {
 }
 
 Directories::~Directories() {
+  changed_directories_connection.disconnect();
   dispatcher.disconnect();
 }
 
@@ -390,7 +396,9 @@ void Directories::open(const boost::filesystem::path &dir_path) {
   }
   directories.clear();
   
-  add_or_update_path(path, Gtk::TreeModel::Row(), true);
+  add_or_update_path(path, Gtk::TreeModel::Row(), true, false);
+  
+  LanguageProtocol::Client::prespawn(path);
 }
 
 void Directories::update() {
@@ -456,7 +464,7 @@ void Directories::select(const boost::filesystem::path &select_path) {
   for(auto &a_path: paths) {
     tree_store->foreach_iter([this, &a_path](const Gtk::TreeModel::iterator &iter){
       if(iter->get_value(column_record.path)==a_path) {
-        add_or_update_path(a_path, *iter, true);
+        add_or_update_path(a_path, *iter, true, false);
         return true;
       }
       return false;
@@ -504,7 +512,7 @@ bool Directories::on_button_press_event(GdkEventButton* event) {
   return Gtk::TreeView::on_button_press_event(event);
 }
 
-void Directories::add_or_update_path(const boost::filesystem::path &dir_path, const Gtk::TreeModel::Row &row, bool include_parent_paths) {
+void Directories::add_or_update_path(const boost::filesystem::path &dir_path, const Gtk::TreeModel::Row &row, bool include_parent_paths, bool read_in_background) {
   auto path_it=directories.find(dir_path.string());
   if(!boost::filesystem::exists(dir_path)) {
     if(path_it!=directories.end())
@@ -515,8 +523,6 @@ void Directories::add_or_update_path(const boost::filesystem::path &dir_path, co
   if(path_it==directories.end()) {
     auto g_file=Gio::File::create_for_path(dir_path.string());
     auto monitor=g_file->monitor_directory(Gio::FileMonitorFlags::FILE_MONITOR_WATCH_MOVES);
-    auto path_and_row=std::make_shared<std::pair<boost::filesystem::path, Gtk::TreeModel::Row> >(dir_path, row);
-    auto connection=std::make_shared<sigc::connection>();
     
     std::shared_ptr<Git::Repository> repository;
     try {
@@ -524,94 +530,161 @@ void Directories::add_or_update_path(const boost::filesystem::path &dir_path, co
     }
     catch(const std::exception &) {}
     
-    monitor->signal_changed().connect([this, connection, path_and_row, repository] (const Glib::RefPtr<Gio::File> &file,
-                                                                        const Glib::RefPtr<Gio::File>&,
-                                                                        Gio::FileMonitorEvent monitor_event) {
+    monitor->signal_changed().connect([this, dir_path=dir_path.string(), repository] (const Glib::RefPtr<Gio::File> &file,
+                                                                                    const Glib::RefPtr<Gio::File>&,
+                                                                                    Gio::FileMonitorEvent monitor_event) {
       if(monitor_event!=Gio::FileMonitorEvent::FILE_MONITOR_EVENT_CHANGES_DONE_HINT) {
         if(repository)
-          repository->clear_saved_status();
-        connection->disconnect();
-        *connection=Glib::signal_timeout().connect([path_and_row, this]() {
-          if(directories.find(path_and_row->first.string())!=directories.end())
-            add_or_update_path(path_and_row->first, path_and_row->second, true);
+          repository->clear_saved_status(dir_path);
+        if(file) {
+          auto basename=file->get_basename();
+          // For instance after git init, or when a repository is removed
+          if(basename==".git")
+            Git::clear_root_paths();
+          // For instance when a subproject is added or removed
+          else if(basename=="CMakeLists.txt" || basename=="meson.build" || basename=="Cargo.toml" || basename=="package.json")
+            Project::Build::clear_cache();
+        }
+        changed_directories.emplace(dir_path);
+        auto now=std::chrono::steady_clock::now();
+        if(!changed_directories_connection.connected())
+          changed_directories_time=now;
+        // The update is not postponed further after a while, since a directory that changes constantly would otherwise delay the updates of all the directories
+        else if(now-changed_directories_time>=std::chrono::seconds(2))
+          return;
+        changed_directories_connection.disconnect();
+        changed_directories_connection=Glib::signal_timeout().connect([this]() {
+          auto dir_paths=std::move(changed_directories);
+          changed_directories.clear();
+          for(auto &dir_path: dir_paths) {
+            auto it=directories.find(dir_path);
+            if(it!=directories.end())
+              add_or_update_path(dir_path, it->second.row, true);
+          }
           return false;
         }, 500);
       }
     });
     
-    std::shared_ptr<sigc::connection> repository_connection(new sigc::connection(), [](sigc::connection *connection) {
-      connection->disconnect();
-      delete connection;
-    });
-    
+    // The directories of a repository share one connection to its monitor, that is disconnected when the last directory is removed
+    std::shared_ptr<sigc::connection> repository_connection;
     if(repository) {
-      auto connection=std::make_shared<sigc::connection>();
-      *repository_connection=repository->monitor->signal_changed().connect([this, connection, path_and_row](const Glib::RefPtr<Gio::File> &file,
-                                                                                                            const Glib::RefPtr<Gio::File>&,
-                                                                                                            Gio::FileMonitorEvent monitor_event) {
-        if(monitor_event!=Gio::FileMonitorEvent::FILE_MONITOR_EVENT_CHANGES_DONE_HINT) {
+      auto git_path=repository->get_path().string();
+      auto &weak_repository_connection=repository_connections[git_path];
+      repository_connection=weak_repository_connection.lock();
+      if(!repository_connection) {
+        repository_connection=std::shared_ptr<sigc::connection>(new sigc::connection(), [this, git_path](sigc::connection *connection) {
           connection->disconnect();
-          *connection=Glib::signal_timeout().connect([this, path_and_row] {
-            if(directories.find(path_and_row->first.string())!=directories.end())
-              colorize_path(path_and_row->first, false);
-            return false;
-          }, 500);
-        }
-      });
+          delete connection;
+          repository_connections.erase(git_path);
+        });
+        weak_repository_connection=repository_connection;
+        auto connection=std::make_shared<sigc::connection>();
+        *repository_connection=repository->monitor->signal_changed().connect([this, connection, repository=repository.get()](const Glib::RefPtr<Gio::File> &file,
+                                                                                                                             const Glib::RefPtr<Gio::File>&,
+                                                                                                                             Gio::FileMonitorEvent monitor_event) {
+          if(monitor_event!=Gio::FileMonitorEvent::FILE_MONITOR_EVENT_CHANGES_DONE_HINT) {
+            connection->disconnect();
+            *connection=Glib::signal_timeout().connect([this, repository] {
+              for(auto &directory: directories) {
+                if(directory.second.repository.get()==repository)
+                  colorize_path(directory.first, false);
+              }
+              return false;
+            }, 500);
+          }
+        });
+      }
     }
     directories[dir_path.string()]={row, monitor, repository, repository_connection};
   }
   
+  auto generation=++read_generation;
+  directories[dir_path.string()].read_generation=generation;
+  if(!read_in_background) {
+    update_children(dir_path, row, include_parent_paths, read_directory(dir_path));
+    return;
+  }
+  
+  std::thread read_thread([this, dir_path, row, include_parent_paths, generation] {
+    auto entries=std::make_shared<std::vector<DirectoryEntry>>(read_directory(dir_path));
+    dispatcher.post([this, dir_path, row, include_parent_paths, generation, entries] {
+      auto it=directories.find(dir_path.string());
+      if(it!=directories.end() && it->second.read_generation==generation)
+        update_children(dir_path, row, include_parent_paths, *entries);
+    });
+  });
+  read_thread.detach();
+}
+
+std::vector<Directories::DirectoryEntry> Directories::read_directory(const boost::filesystem::path &dir_path) {
+  std::vector<DirectoryEntry> entries;
+  boost::system::error_code ec;
+  boost::filesystem::directory_iterator end_it;
+  for(boost::filesystem::directory_iterator it(dir_path, ec);it!=end_it;it.increment(ec)) {
+    if(ec)
+      break;
+    boost::system::error_code is_directory_ec;
+    auto is_directory=boost::filesystem::is_directory(it->path(), is_directory_ec);
+    auto type=PathType::KNOWN;
+    if(!is_directory && !Source::guess_language(it->path().filename()))
+      type=PathType::UNKNOWN;
+    entries.emplace_back(DirectoryEntry{it->path().filename().string(), it->path(), is_directory, type});
+  }
+  return entries;
+}
+
+void Directories::update_children(const boost::filesystem::path &dir_path, const Gtk::TreeModel::Row &row, bool include_parent_paths, const std::vector<DirectoryEntry> &entries) {
   Gtk::TreeNodeChildren children(row?row.children():tree_store->children());
   if(children) {
     if(children.begin()->get_value(column_record.path)=="")
       tree_store->erase(children.begin());
   }
+  
+  std::unordered_map<std::string, Gtk::TreeModel::iterator> existing_children;
+  for(auto it=children.begin();it!=children.end();++it)
+    existing_children.emplace(it->get_value(column_record.name), it);
+  
+  std::vector<const DirectoryEntry *> new_entries;
   std::unordered_set<std::string> not_deleted;
-  boost::filesystem::directory_iterator end_it;
-  for(boost::filesystem::directory_iterator it(dir_path);it!=end_it;it++) {
-    auto filename=it->path().filename().string();
-    bool already_added=false;
-    if(children) {
-      for(auto &child: children) {
-        if(child->get_value(column_record.name)==filename) {
-          not_deleted.emplace(filename);
-          already_added=true;
-          break;
-        }
-      }
-    }
-    if(!already_added) {
-      auto child = tree_store->append(children);
-      not_deleted.emplace(filename);
-      child->set_value(column_record.name, filename);
-      child->set_value(column_record.markup, Glib::Markup::escape_text(filename));
-      child->set_value(column_record.path, it->path());
-      if (boost::filesystem::is_directory(it->path())) {
-        child->set_value(column_record.id, '1'+filename);
-        auto grandchild=tree_store->append(child->children());
-        grandchild->set_value(column_record.name, std::string("(empty)"));
-        grandchild->set_value(column_record.markup, Glib::Markup::escape_text("(empty)"));
-        grandchild->set_value(column_record.type, PathType::UNKNOWN);
-      }
-      else {
-        child->set_value(column_record.id, '2'+filename);
-        
-        auto language=Source::guess_language(it->path().filename());
-        if(!language)
-          child->set_value(column_record.type, PathType::UNKNOWN);
-      }
-    }
+  for(auto &entry: entries) {
+    not_deleted.emplace(entry.filename);
+    if(existing_children.count(entry.filename)==0)
+      new_entries.emplace_back(&entry);
   }
-  if(children) {
-    for(auto it=children.begin();it!=children.end();) {
-      if(not_deleted.count(it->get_value(column_record.name))==0) {
-        it=tree_store->erase(it);
-      }
-      else
-        it++;
+  
+  for(auto it=children.begin();it!=children.end();) {
+    if(not_deleted.count(it->get_value(column_record.name))==0)
+      it=tree_store->erase(it);
+    else
+      it++;
+  }
+  
+  // Sorting each inserted row is linear in the number of siblings, so the rows are sorted once after large insertions
+  bool suspend_sorting=new_entries.size()>100;
+  if(suspend_sorting)
+    tree_store->set_sort_column(GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID, Gtk::SortType::SORT_ASCENDING);
+  for(auto &entry: new_entries) {
+    auto child = tree_store->append(children);
+    child->set_value(column_record.name, entry->filename);
+    child->set_value(column_record.markup, Glib::Markup::escape_text(entry->filename));
+    child->set_value(column_record.path, entry->path);
+    if (entry->is_directory) {
+      child->set_value(column_record.id, '1'+entry->filename);
+      auto grandchild=tree_store->append(child->children());
+      grandchild->set_value(column_record.name, std::string("(empty)"));
+      grandchild->set_value(column_record.markup, Glib::Markup::escape_text("(empty)"));
+      grandchild->set_value(column_record.type, PathType::UNKNOWN);
+    }
+    else {
+      child->set_value(column_record.id, '2'+entry->filename);
+      if(entry->type==PathType::UNKNOWN)
+        child->set_value(column_record.type, PathType::UNKNOWN);
     }
   }
+  if(suspend_sorting)
+    tree_store->set_sort_column(column_record.id, Gtk::SortType::SORT_ASCENDING);
+  
   if(!children) {
     auto child=tree_store->append(children);
     child->set_value(column_record.name, std::string("(empty)"));
@@ -647,84 +720,109 @@ void Directories::remove_path(const boost::filesystem::path &dir_path) {
 }
 
 void Directories::colorize_path(boost::filesystem::path dir_path_, bool include_parent_paths) {
-  auto dir_path=std::make_shared<boost::filesystem::path>(std::move(dir_path_));
-  auto it=directories.find(dir_path->string());
-  if(it==directories.end())
+  auto it=directories.find(dir_path_.string());
+  if(it==directories.end() || !it->second.repository)
     return;
   
-  if(it!=directories.end() && it->second.repository) {
-    auto repository=it->second.repository;
-    std::thread git_status_thread([this, dir_path, repository, include_parent_paths] {
-      Git::Repository::Status status;
+  std::unique_lock<std::mutex> lock(colorize_mutex);
+  auto &include_parent_paths_value=colorize_queue[it->second.repository][dir_path_.string()];
+  include_parent_paths_value=include_parent_paths_value || include_parent_paths;
+  if(colorize_thread_running)
+    return;
+  colorize_thread_running=true;
+  
+  // One thread scans the status of all the queued directories of a repository at once
+  std::thread git_status_thread([this] {
+    while(true) {
+      std::unique_lock<std::mutex> lock(colorize_mutex);
+      if(colorize_queue.empty()) {
+        colorize_thread_running=false;
+        return;
+      }
+      auto repository=colorize_queue.begin()->first;
+      auto dir_paths=std::move(colorize_queue.begin()->second);
+      colorize_queue.erase(colorize_queue.begin());
+      lock.unlock();
+      
+      std::vector<boost::filesystem::path> status_paths;
+      for(auto &dir_path: dir_paths)
+        status_paths.emplace_back(dir_path.first);
+      std::shared_ptr<const Git::Repository::Status> status;
       try {
-        status=repository->get_status();
+        status=repository->get_status(status_paths);
       }
       catch(const std::exception &e) {
         Terminal::get().async_print(std::string("Error (git): ")+e.what()+'\n', true);
+        status=std::make_shared<Git::Repository::Status>();
       }
       
-      dispatcher.post([this, dir_path, include_parent_paths, status=std::move(status)] {
-        auto it=directories.find(dir_path->string());
-        if(it==directories.end())
-          return;
-        
-        auto normal_color=get_style_context()->get_color(Gtk::StateFlags::STATE_FLAG_NORMAL);
-        Gdk::RGBA gray;
-        gray.set_rgba(0.5, 0.5, 0.5);
-        Gdk::RGBA yellow;
-        yellow.set_rgba(1.0, 1.0, 0.2);
-        double factor=0.5;
-        yellow.set_red(normal_color.get_red()+factor*(yellow.get_red()-normal_color.get_red()));
-        yellow.set_green(normal_color.get_green()+factor*(yellow.get_green()-normal_color.get_green()));
-        yellow.set_blue(normal_color.get_blue()+factor*(yellow.get_blue()-normal_color.get_blue()));
-        Gdk::RGBA green;
-        green.set_rgba(0.0, 1.0, 0.0);
-        factor=0.4;
-        green.set_red(normal_color.get_red()+factor*(green.get_red()-normal_color.get_red()));
-        green.set_green(normal_color.get_green()+factor*(green.get_green()-normal_color.get_green()));
-        green.set_blue(normal_color.get_blue()+factor*(green.get_blue()-normal_color.get_blue()));
-        
-        do {
-          Gtk::TreeNodeChildren children(it->second.row?it->second.row.children():tree_store->children());
-          if(!children)
-            return;
-          
-          for(auto &child: children) {
-            auto name=Glib::Markup::escape_text(child.get_value(column_record.name));
-            auto path=child.get_value(column_record.path);
-            Gdk::RGBA *color;
-            if(status.modified.find(path.generic_string())!=status.modified.end())
-              color=&yellow;
-            else if(status.added.find(path.generic_string())!=status.added.end())
-              color=&green;
-            else
-              color=&normal_color;
-            
-            std::stringstream ss;
-            ss << '#' << std::setfill('0') << std::hex;
-            ss << std::setw(2) << std::hex << (color->get_red_u()>>8);
-            ss << std::setw(2) << std::hex << (color->get_green_u()>>8);
-            ss << std::setw(2) << std::hex << (color->get_blue_u()>>8);
-            child.set_value(column_record.markup, "<span foreground=\""+ss.str()+"\">"+name+"</span>");
-            
-            auto type=child.get_value(column_record.type);
-            if(type==PathType::UNKNOWN)
-              child.set_value(column_record.markup, "<i>"+child.get_value(column_record.markup)+"</i>");
-          }
-          
-          if(!include_parent_paths)
-            break;
-          
-          auto path=boost::filesystem::path(it->first);
-          if(boost::filesystem::exists(path/".git"))
-            break;
-          if(path==path.root_directory())
-            break;
-          auto parent_path=boost::filesystem::path(it->first).parent_path();
-          it=directories.find(parent_path.string());
-        } while(it!=directories.end());
+      dispatcher.post([this, dir_paths=std::move(dir_paths), status] {
+        for(auto &dir_path: dir_paths)
+          colorize_path(dir_path.first, dir_path.second, *status);
       });
-    });
-    git_status_thread.detach();
-  }
+    }
+  });
+  git_status_thread.detach();
+}
+
+void Directories::colorize_path(const std::string &dir_path, bool include_parent_paths, const Git::Repository::Status &status) {
+  auto it=directories.find(dir_path);
+  if(it==directories.end())
+    return;
+  
+  auto normal_color=get_style_context()->get_color(Gtk::StateFlags::STATE_FLAG_NORMAL);
+  Gdk::RGBA gray;
+  gray.set_rgba(0.5, 0.5, 0.5);
+  Gdk::RGBA yellow;
+  yellow.set_rgba(1.0, 1.0, 0.2);
+  double factor=0.5;
+  yellow.set_red(normal_color.get_red()+factor*(yellow.get_red()-normal_color.get_red()));
+  yellow.set_green(normal_color.get_green()+factor*(yellow.get_green()-normal_color.get_green()));
+  yellow.set_blue(normal_color.get_blue()+factor*(yellow.get_blue()-normal_color.get_blue()));
+  Gdk::RGBA green;
+  green.set_rgba(0.0, 1.0, 0.0);
+  factor=0.4;
+  green.set_red(normal_color.get_red()+factor*(green.get_red()-normal_color.get_red()));
+  green.set_green(normal_color.get_green()+factor*(green.get_green()-normal_color.get_green()));
+  green.set_blue(normal_color.get_blue()+factor*(green.get_blue()-normal_color.get_blue()));
+  
+  do {
+    Gtk::TreeNodeChildren children(it->second.row?it->second.row.children():tree_store->children());
+    if(!children)
+      return;
+    
+    for(auto &child: children) {
+      auto name=Glib::Markup::escape_text(child.get_value(column_record.name));
+      auto path=child.get_value(column_record.path);
+      Gdk::RGBA *color;
+      if(status.is_modified(path))
+        color=&yellow;
+      else if(status.is_added(path))
+        color=&green;
+      else
+        color=&normal_color;
+      
+      std::stringstream ss;
+      ss << '#' << std::setfill('0') << std::hex;
+      ss << std::setw(2) << std::hex << (color->get_red_u()>>8);
+      ss << std::setw(2) << std::hex << (color->get_green_u()>>8);
+      ss << std::setw(2) << std::hex << (color->get_blue_u()>>8);
+      child.set_value(column_record.markup, "<span foreground=\""+ss.str()+"\">"+name+"</span>");
+      
+      auto type=child.get_value(column_record.type);
+      if(type==PathType::UNKNOWN)
+        child.set_value(column_record.markup, "<i>"+child.get_value(column_record.markup)+"</i>");
+    }
+    
+    if(!include_parent_paths)
+      break;
+    
+    auto path=boost::filesystem::path(it->first);
+    if(boost::filesystem::exists(path/".git"))
+      break;
+    if(path==path.root_directory())
+      break;
+    auto parent_path=boost::filesystem::path(it->first).parent_path();
+    it=directories.find(parent_path.string());
+  } while(it!=directories.end());
 }
@@ -6,11 +6,16 @@
 #include <thread>
 #include <mutex>
 #include <atomic>
+#include <chrono>
+#include <map>
+#include <set>
 #include <unordered_map>
 #include <unordered_set>
 #include "git.h"
 #include "dispatcher.h"
 
+/// The directory tree. Rows only exist for the open directory and its expanded subdirectories, and collapsing a directory removes
+/// its rows. Each of these directories has a Gio::FileMonitor, since inotify can not watch directories recursively.
 class Directories : public Gtk::ListViewText {
   class DirectoryData {
   public:
@@ -18,10 +23,21 @@ class Directories : public Gtk::ListViewText {
     Glib::RefPtr<Gio::FileMonitor> monitor;
     std::shared_ptr<Git::Repository> repository;
     std::shared_ptr<sigc::connection> connection;
+    /// Generation of the latest read of the directory, so that only the latest read is shown
+    size_t read_generation=0;
   };
   
   enum class PathType {KNOWN, UNKNOWN};
   
+  class DirectoryEntry {
+  public:
+    std::string filename;
+    boost::filesystem::path path;
+    bool is_directory;
+    /// UNKNOWN for files without a language, found in the reading thread since guessing the language is slow
+    PathType type;
+  };
+  
   class TreeStore : public Gtk::TreeStore {
   protected:
     TreeStore()=default;
@@ -69,14 +85,34 @@ protected:
   bool on_button_press_event(GdkEventButton *event) override;
   
 private:
-  void add_or_update_path(const boost::filesystem::path &dir_path, const Gtk::TreeModel::Row &row, bool include_parent_paths);
+  /// Reads the directory in a thread, unless read_in_background is false, and updates the children of row
+  void add_or_update_path(const boost::filesystem::path &dir_path, const Gtk::TreeModel::Row &row, bool include_parent_paths, bool read_in_background=true);
+  /// Reads the entries of a directory, and guesses the languages of the files. Can be called from any thread.
+  static std::vector<DirectoryEntry> read_directory(const boost::filesystem::path &dir_path);
+  void update_children(const boost::filesystem::path &dir_path, const Gtk::TreeModel::Row &row, bool include_parent_paths, const std::vector<DirectoryEntry> &entries);
   void remove_path(const boost::filesystem::path &dir_path);
   void colorize_path(boost::filesystem::path dir_path_, bool include_parent_paths);
+  void colorize_path(const std::string &dir_path, bool include_parent_paths, const Git::Repository::Status &status);
+  
+  std::mutex colorize_mutex;
+  /// Directories waiting for their git status, and whether their parent directories should be colorized as well
+  std::map<std::shared_ptr<Git::Repository>, std::unordered_map<std::string, bool>> colorize_queue;
+  bool colorize_thread_running=false;
   
   Glib::RefPtr<Gtk::TreeStore> tree_store;
   TreeStore::ColumnRecord column_record;
   
+  /// Connections to the repository monitors by git path, shared by the directories of each repository.
+  /// Declared before directories, since an entry is erased when the last directory using it is removed.
+  std::unordered_map<std::string, std::weak_ptr<sigc::connection>> repository_connections;
   std::unordered_map<std::string, DirectoryData> directories;
+  /// Directories with changes, that are updated together after the directory monitors have been quiet for a while
+  std::set<std::string> changed_directories;
+  sigc::connection changed_directories_connection;
+  /// Time of the first change in changed_directories
+  std::chrono::steady_clock::time_point changed_directories_time;
+  /// Incremented for each directory read
+  size_t read_generation=0;
   
   Dispatcher dispatcher;
   
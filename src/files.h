@@ -66,7 +66,12 @@ R"RAW(
         "clang_usages_threads": -1
     },
     "terminal": {
+        "history_size_comment": "Number of lines shown in the terminal. Earlier lines are shown when scrolling to the top of the terminal",
         "history_size": 1000,
+        "scrollback_size_comment": "Number of lines of output kept for scrolling back, in addition to the lines shown",
+        "scrollback_size": 100000,
+        "output_rate_limit_comment": "Maximum number of bytes per second of process output shown in the terminal, where further output is omitted. Use 0 to show all output",
+        "output_rate_limit": 1000000,
         "font_comment": "Use \"\" to use source.font with slightly smaller size",
         "font": ""
     },
@@ -92,6 +97,8 @@ R"RAW(
         "source_spellcheck_next_error": "<primary><shift>e",
         "source_git_next_diff": "<primary>k",
         "source_git_show_diff": "<alt>k",
+        "source_git_toggle_blame": "",
+        "source_git_changed_files": "",
         "source_indentation_set_buffer_tab": "",
         "source_indentation_auto_indent_buffer": "<primary><shift>i",
         "source_goto_line": "<primary>g",
@@ -117,6 +124,10 @@ R"RAW(
         "project_set_run_arguments": "",
         "project_compile_and_run": "<primary>Return",
         "project_compile": "<primary><shift>Return",
+        "project_compile_file": "",
+        "project_check_file_syntax": "<primary><alt>Return",
+        "project_cancel_build": "",
+        "project_show_build_diagnostics": "",
         "project_run_command": "<alt>Return",
         "project_kill_last_running": "<primary>Escape",
         "project_force_kill_last_running": "<primary><shift>Escape",
@@ -175,6 +186,8 @@ R"RAW(
             "command": "meson",
             "compile_command": "ninja"
         },
+        "build_jobs_comment": "Number of parallel jobs added to the CMake and Meson compile commands. Use 0 for the number of processor cores",
+        "build_jobs": 0,
         "save_on_compile_or_run": true,
         "clear_terminal_on_compile": true,
         "ctags_command": "ctags",
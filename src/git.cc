@@ -1,8 +1,12 @@
 #include "git.h"
+#include <algorithm>
 #include <cstring>
+#include <fstream>
 
 bool Git::initialized=false;
 std::mutex Git::mutex;
+std::unordered_map<std::string, boost::filesystem::path> Git::root_paths;
+std::mutex Git::root_paths_mutex;
 
 std::string Git::Error::message() noexcept {
   const git_error *last_error = giterr_last();
@@ -12,44 +16,19 @@ std::string Git::Error::message() noexcept {
     return last_error->message;
 }
 
-Git::Repository::Diff::Diff(const boost::filesystem::path &path, git_repository *repository) : repository(repository) {
-  blob=std::shared_ptr<git_blob>(nullptr, [](git_blob *blob) {
+Git::Repository::Diff::Diff(git_blob *blob_) {
+  blob=std::shared_ptr<git_blob>(blob_, [](git_blob *blob) {
     if(blob) git_blob_free(blob);
   });
-  Error error;
-  std::lock_guard<std::mutex> lock(mutex);
-  auto spec="HEAD:"+path.generic_string();
-  error.code = git_revparse_single(reinterpret_cast<git_object**>(&blob), repository, spec.c_str());
-  if(error)
-    throw std::runtime_error(error.message());
-  
-  git_diff_init_options(&options, GIT_DIFF_OPTIONS_VERSION);
-  options.context_lines=0;
-}
-
-//Based on https://github.com/atom/git-diff/blob/master/lib/git-diff-view.coffee
-int Git::Repository::Diff::hunk_cb(const git_diff_delta *delta, const git_diff_hunk *hunk, void *payload) noexcept {
-  auto lines=static_cast<Lines*>(payload);
-  auto start=hunk->new_start-1;
-  auto end=hunk->new_start+hunk->new_lines-1;
-  if(hunk->old_lines==0 && hunk->new_lines>0)
-    lines->added.emplace_back(start, end);
-  else if(hunk->new_lines==0 && hunk->old_lines>0)
-    lines->removed.emplace_back(start);
-  else
-    lines->modified.emplace_back(start, end);
-    
-  return 0;
-}
-
-Git::Repository::Diff::Lines Git::Repository::Diff::get_lines(const std::string &buffer) {
-  Lines lines;
-  Error error;
-  std::lock_guard<std::mutex> lock(mutex);
-  error.code=git_diff_blob_to_buffer(blob.get(), nullptr, buffer.c_str(), buffer.size(), nullptr, &options, nullptr, nullptr, hunk_cb, nullptr, &lines);
-  if(error)
-    throw std::runtime_error(error.message());
-  return lines;
+  auto text=static_cast<const char *>(git_blob_rawcontent(blob.get()));
+  auto size=static_cast<size_t>(git_blob_rawsize(blob.get()));
+  line_hashes=get_line_hashes(text, size);
+  line_offsets.reserve(line_hashes.size());
+  line_offsets.emplace_back(0);
+  for(size_t c=0;c<size;++c) {
+    if(text[c]=='\n')
+      line_offsets.emplace_back(c+1);
+  }
 }
 
 std::vector<Git::Repository::Diff::Hunk> Git::Repository::Diff::get_hunks(const std::string &old_buffer, const std::string &new_buffer) {
@@ -69,58 +48,209 @@ std::vector<Git::Repository::Diff::Hunk> Git::Repository::Diff::get_hunks(const
   return hunks;
 }
 
-int Git::Repository::Diff::line_cb(const git_diff_delta *delta, const git_diff_hunk *hunk, const git_diff_line *line, void *payload) noexcept {
-  auto details=static_cast<std::pair<std::string, int> *>(payload);
-  auto line_nr=details->second;
-  auto start=hunk->new_start-1;
-  auto end=hunk->new_start+hunk->new_lines-1;
-  if(line_nr==start || (line_nr>=start && line_nr<end)) {
-    if(details->first.empty())
-      details->first+=std::string(hunk->header, hunk->header_len);
-    details->first+=line->origin+std::string(line->content, line->content_len);
+std::vector<Git::Repository::Diff::Hunk> Git::Repository::Diff::get_hunks(const std::vector<size_t> &old_line_hashes, const std::vector<size_t> &new_line_hashes) {
+  std::vector<Hunk> hunks;
+  
+  size_t prefix=0;
+  while(prefix<old_line_hashes.size() && prefix<new_line_hashes.size() && old_line_hashes[prefix]==new_line_hashes[prefix])
+    ++prefix;
+  size_t suffix=0;
+  while(suffix<old_line_hashes.size()-prefix && suffix<new_line_hashes.size()-prefix &&
+        old_line_hashes[old_line_hashes.size()-1-suffix]==new_line_hashes[new_line_hashes.size()-1-suffix])
+    ++suffix;
+  auto old_begin=old_line_hashes.begin()+prefix;
+  auto new_begin=new_line_hashes.begin()+prefix;
+  int old_size=static_cast<int>(old_line_hashes.size()-prefix-suffix);
+  int new_size=static_cast<int>(new_line_hashes.size()-prefix-suffix);
+  if(old_size==0 && new_size==0)
+    return hunks;
+  
+  // Myers' diff algorithm, storing the furthest reaching x of diagonals -d to d for each d
+  const int max_d=2000;
+  std::vector<std::vector<int>> trace;
+  std::vector<int> v(2*(old_size+new_size)+3, 0);
+  auto offset=old_size+new_size+1;
+  int d=0;
+  bool found=old_size==0 || new_size==0;
+  for(;!found && d<=old_size+new_size && d<=max_d;++d) {
+    for(int k=-d;k<=d;k+=2) {
+      int x;
+      if(k==-d || (k!=d && v[offset+k-1]<v[offset+k+1]))
+        x=v[offset+k+1];
+      else
+        x=v[offset+k-1]+1;
+      auto y=x-k;
+      while(x<old_size && y<new_size && *(old_begin+x)==*(new_begin+y)) {
+        ++x;
+        ++y;
+      }
+      v[offset+k]=x;
+      if(x>=old_size && y>=new_size) {
+        found=true;
+        break;
+      }
+    }
+    trace.emplace_back(v.begin()+offset-d, v.begin()+offset+d+1);
   }
-  return 0;
+  
+  if(!found || d==0 || old_size==0 || new_size==0) { // Too many differences, or only added or removed lines
+    hunks.emplace_back(prefix, old_size, prefix, new_size);
+    return hunks;
+  }
+  
+  // Backtrack to find the removed (old) and added (new) lines
+  std::vector<std::pair<int, int>> removed, added;
+  int x=old_size, y=new_size;
+  for(d=static_cast<int>(trace.size())-1;d>0;--d) {
+    auto &previous=trace[d-1];
+    auto k=x-y;
+    int previous_k;
+    if(k==-d || (k!=d && previous[k-1+d-1]<previous[k+1+d-1]))
+      previous_k=k+1;
+    else
+      previous_k=k-1;
+    auto previous_x=previous[previous_k+d-1];
+    auto previous_y=previous_x-previous_k;
+    if(previous_k==k+1)
+      added.emplace_back(previous_x, previous_y);
+    else
+      removed.emplace_back(previous_x, previous_y);
+    x=previous_x;
+    y=previous_y;
+  }
+  
+  // Join consecutive removed and added lines into hunks
+  std::vector<std::pair<bool, std::pair<int, int>>> edits; // Added, and position in old and new
+  for(auto &position: removed)
+    edits.emplace_back(false, position);
+  for(auto &position: added)
+    edits.emplace_back(true, position);
+  std::sort(edits.begin(), edits.end(), [](const std::pair<bool, std::pair<int, int>> &a, const std::pair<bool, std::pair<int, int>> &b) {
+    return a.second.first<b.second.first || (a.second.first==b.second.first && a.second.second<b.second.second);
+  });
+  for(auto &edit: edits) {
+    auto old_start=static_cast<int>(prefix)+edit.second.first;
+    auto new_start=static_cast<int>(prefix)+edit.second.second;
+    if(hunks.empty() || hunks.back().old_lines.first+hunks.back().old_lines.second!=old_start || hunks.back().new_lines.first+hunks.back().new_lines.second!=new_start)
+      hunks.emplace_back(old_start, 0, new_start, 0);
+    if(edit.first)
+      ++hunks.back().new_lines.second;
+    else
+      ++hunks.back().old_lines.second;
+  }
+  return hunks;
 }
 
-std::string Git::Repository::Diff::get_details(const std::string &buffer, int line_nr) {
-  std::pair<std::string, int> details;
-  details.second=line_nr;
-  Error error;
-  std::lock_guard<std::mutex> lock(mutex);
-  error.code=git_diff_blob_to_buffer(blob.get(), nullptr, buffer.c_str(), buffer.size(), nullptr, &options, nullptr, nullptr, nullptr, line_cb, &details);
-  if(error)
-    throw std::runtime_error(error.message());
-  return details.first;
+std::vector<size_t> Git::Repository::Diff::get_line_hashes(const char *text, size_t size) {
+  std::vector<size_t> line_hashes;
+  size_t line_start=0;
+  for(size_t c=0;c<size;++c) {
+    if(text[c]=='\n') {
+      line_hashes.emplace_back(get_line_hash(text+line_start, c-line_start));
+      line_start=c+1;
+    }
+  }
+  line_hashes.emplace_back(get_line_hash(text+line_start, size-line_start));
+  return line_hashes;
 }
 
-Git::Repository::Repository(const boost::filesystem::path &path) {
-  git_repository *repository_ptr;
-  {
-    Error error;
-    std::lock_guard<std::mutex> lock(mutex);
-    error.code = git_repository_open_ext(&repository_ptr, path.generic_string().c_str(), 0, nullptr);
-    if(error)
-      throw std::runtime_error(error.message());
-  }
-  repository=std::unique_ptr<git_repository, std::function<void(git_repository *)> >(repository_ptr, [](git_repository *ptr) {
-    git_repository_free(ptr);
+std::string Git::Repository::Diff::get_text(const std::pair<int, int> &lines) {
+  if(lines.first<0 || lines.second<=0 || lines.first>=static_cast<int>(line_offsets.size()))
+    return std::string();
+  auto text=static_cast<const char *>(git_blob_rawcontent(blob.get()));
+  auto start=line_offsets[lines.first];
+  auto end=lines.first+lines.second<static_cast<int>(line_offsets.size()) ? line_offsets[lines.first+lines.second] : static_cast<size_t>(git_blob_rawsize(blob.get()));
+  return std::string(text+start, end-start);
+}
+
+size_t Git::Repository::Diff::get_line_hash(const char *line, size_t size) {
+  if(size>0 && line[size-1]=='\r')
+    --size;
+  return std::hash<std::string>()(std::string(line, size));
+}
+
+int Git::Repository::Blame::get_hunk_index(int line) const noexcept {
+  auto it=std::upper_bound(hunks.begin(), hunks.end(), line, [](int line, const Hunk &hunk) {
+    return line<hunk.lines.first;
   });
+  if(it==hunks.begin())
+    return -1;
+  --it;
+  if(line>=it->lines.first+it->lines.second)
+    return -1;
+  return it-hunks.begin();
+}
+
+void Git::Repository::Blame::write(std::ostream &stream) const {
+  for(auto &hunk: hunks)
+    stream << hunk.lines.first << ' ' << hunk.lines.second << ' ' << hunk.commit_id << ' ' << hunk.time << ' ' << hunk.author << '\n';
+}
+
+bool Git::Repository::Blame::read(std::istream &stream) {
+  Hunk hunk;
+  while(stream >> hunk.lines.first >> hunk.lines.second >> hunk.commit_id >> hunk.time) {
+    stream.get();
+    if(!std::getline(stream, hunk.author))
+      return false;
+    hunks.emplace_back(std::move(hunk));
+  }
+  return stream.eof() && !hunks.empty();
+}
+
+void Git::Repository::Blame::prune_cache(const boost::filesystem::path &cache_directory, size_t max_files) {
+  std::vector<std::pair<std::time_t, boost::filesystem::path>> files;
+  boost::system::error_code ec;
+  for(boost::filesystem::directory_iterator it(cache_directory, ec), end;!ec && it!=end;it.increment(ec)) {
+    auto time=boost::filesystem::last_write_time(it->path(), ec);
+    if(!ec)
+      files.emplace_back(time, it->path());
+  }
+  if(files.size()<=max_files)
+    return;
+  std::nth_element(files.begin(), files.begin()+(files.size()-max_files), files.end());
+  for(auto it=files.begin();it!=files.begin()+(files.size()-max_files);++it)
+    boost::filesystem::remove(it->second, ec);
+}
+
+Git::Repository::Repository(const boost::filesystem::path &path) {
+  repository=open(path);
   
-  work_path=get_work_path();
+  git_path=Git::path(git_repository_path(repository.get()));
+  work_path=Git::path(git_repository_workdir(repository.get()));
   if(work_path.empty())
     throw std::runtime_error("Could not find work path");
   
-  auto git_directory=Gio::File::create_for_path(get_path().string());
+  auto git_directory=Gio::File::create_for_path(git_path.string());
   monitor=git_directory->monitor_directory(Gio::FileMonitorFlags::FILE_MONITOR_WATCH_MOVES);
   monitor_changed_connection=monitor->signal_changed().connect([this](const Glib::RefPtr<Gio::File> &file,
-                                                                      const Glib::RefPtr<Gio::File>&,
+                                                                      const Glib::RefPtr<Gio::File> &other_file,
                                                                       Gio::FileMonitorEvent monitor_event) {
     if(monitor_event!=Gio::FileMonitorEvent::FILE_MONITOR_EVENT_CHANGES_DONE_HINT) {
-      this->clear_saved_status();
+      // For instance git fetch only writes files that do not affect the status of the work tree
+      auto affects_status=[](const Glib::RefPtr<Gio::File> &file) {
+        if(!file)
+          return false;
+        auto filename=file->get_basename();
+        static std::unordered_set<std::string> filenames_not_affecting_status={"FETCH_HEAD", "ORIG_HEAD", "COMMIT_EDITMSG", "description", "hooks", "logs", "objects"};
+        return filenames_not_affecting_status.count(filename)==0 && !(filename.size()>=5 && filename.compare(filename.size()-5, 5, ".lock")==0);
+      };
+      if(affects_status(file) || affects_status(other_file))
+        this->clear_saved_status();
     }
   }, false);
 }
 
+std::unique_ptr<git_repository, std::function<void(git_repository *)> > Git::Repository::open(const boost::filesystem::path &path) {
+  git_repository *repository_ptr;
+  Error error;
+  error.code = git_repository_open_ext(&repository_ptr, path.generic_string().c_str(), 0, nullptr);
+  if(error)
+    throw std::runtime_error(error.message());
+  return std::unique_ptr<git_repository, std::function<void(git_repository *)> >(repository_ptr, [](git_repository *ptr) {
+    git_repository_free(ptr);
+  });
+}
+
 Git::Repository::~Repository() {
   monitor_changed_connection.disconnect();
 }
@@ -129,6 +259,7 @@ std::string Git::Repository::status_string(STATUS status) noexcept {
   switch(status) {
     case STATUS::CURRENT: return "current";
     case STATUS::NEW: return "new";
+    case STATUS::UNTRACKED: return "untracked";
     case STATUS::MODIFIED: return "modified";
     case STATUS::DELETED: return "deleted";
     case STATUS::RENAMED: return "renamed";
@@ -144,8 +275,10 @@ int Git::Repository::status_callback(const char *path, unsigned int status_flags
   auto callback=static_cast<std::function<void(const char *path, STATUS status)>*>(data);
   
   STATUS status;
-  if((status_flags&(GIT_STATUS_INDEX_NEW|GIT_STATUS_WT_NEW))>0)
+  if((status_flags&GIT_STATUS_INDEX_NEW)>0)
     status=STATUS::NEW;
+  else if((status_flags&GIT_STATUS_WT_NEW)>0)
+    status=STATUS::UNTRACKED;
   else if((status_flags&(GIT_STATUS_INDEX_MODIFIED|GIT_STATUS_WT_MODIFIED))>0)
     status=STATUS::MODIFIED;
   else if((status_flags&(GIT_STATUS_INDEX_DELETED|GIT_STATUS_WT_DELETED))>0)
@@ -169,57 +302,271 @@ int Git::Repository::status_callback(const char *path, unsigned int status_flags
   return 0;
 }
 
-Git::Repository::Status Git::Repository::get_status() {
-  {
-    std::unique_lock<std::mutex> lock(saved_status_mutex);
-    if(has_saved_status)
-      return saved_status;
+bool Git::Repository::is_in_directory(const std::string &path, const std::string &directory) noexcept {
+  if(directory.empty())
+    return true;
+  return path.size()>=directory.size() && path.compare(0, directory.size(), directory)==0 && (path.size()==directory.size() || path[directory.size()]=='/');
+}
+
+bool Git::Repository::get_relative_path(const boost::filesystem::path &path, std::string &relative_path) noexcept {
+  auto path_string=path.generic_string();
+  auto work_path_string=work_path.generic_string();
+  if(path_string==work_path_string) {
+    relative_path.clear();
+    return true;
   }
+  if(path_string.size()>work_path_string.size() && path_string.compare(0, work_path_string.size(), work_path_string)==0 && path_string[work_path_string.size()]=='/') {
+    relative_path=path_string.substr(work_path_string.size()+1);
+    return true;
+  }
+  return false;
+}
+
+std::shared_ptr<const Git::Repository::Status> Git::Repository::get_status(const std::vector<boost::filesystem::path> &directories) {
+  std::vector<std::string> relative_directories;
+  if(directories.empty())
+    relative_directories.emplace_back();
+  for(auto &directory: directories) {
+    std::string relative_directory;
+    if(get_relative_path(directory, relative_directory))
+      relative_directories.emplace_back(std::move(relative_directory));
+  }
+  
+  std::lock_guard<std::mutex> scan_lock(status_scan_mutex);
+  std::unique_lock<std::mutex> lock(saved_status_mutex);
   
-  Status status;
-  bool first=true;
-  std::unique_lock<std::mutex> status_saved_lock(saved_status_mutex, std::defer_lock);
-  std::function<void(const char *path, STATUS status)> callback=[this, &status, &first, &status_saved_lock](const char *path_cstr, STATUS status_enum) {
-    if(first) {
-      status_saved_lock.lock();
-      first=false;
+  // Scan the directories that have not been scanned, and the changed directories that affect the requested directories
+  std::set<std::string> scan_directories;
+  for(auto &directory: relative_directories) {
+    bool scanned=false;
+    for(auto &saved_directory: saved_status_directories) {
+      if(is_in_directory(directory, saved_directory)) {
+        scanned=true;
+        break;
+      }
     }
-    boost::filesystem::path rel_path(path_cstr);
-    do {
-      if(status_enum==STATUS::MODIFIED)
-        status.modified.emplace((work_path/rel_path).generic_string());
-      if(status_enum==STATUS::NEW)
-        status.added.emplace((work_path/rel_path).generic_string());
-      rel_path=rel_path.parent_path();
-    } while(!rel_path.empty());
-  };
-  Error error;
-  std::lock_guard<std::mutex> lock(mutex);
-  error.code = git_status_foreach(repository.get(), status_callback, &callback);
-  if(error)
-    throw std::runtime_error(error.message());
-  saved_status=status;
-  has_saved_status=true;
-  if(status_saved_lock)
-    status_saved_lock.unlock();
+    if(!scanned)
+      scan_directories.emplace(directory);
+    for(auto &changed_directory: changed_status_directories) {
+      if(is_in_directory(directory, changed_directory) || is_in_directory(changed_directory, directory))
+        scan_directories.emplace(changed_directory);
+    }
+  }
+  for(auto it=scan_directories.begin();it!=scan_directories.end();) {
+    bool inside_other=false;
+    for(auto &directory: scan_directories) {
+      if(&directory!=&*it && is_in_directory(*it, directory)) {
+        inside_other=true;
+        break;
+      }
+    }
+    if(inside_other)
+      it=scan_directories.erase(it);
+    else
+      ++it;
+  }
+  
+  if(scan_directories.empty() && saved_status)
+    return saved_status;
+  
+  std::map<std::string, STATUS> files;
+  if(!scan_directories.empty()) {
+    std::vector<std::string> scanned_changed_directories;
+    for(auto it=changed_status_directories.begin();it!=changed_status_directories.end();) {
+      bool scanned=false;
+      for(auto &directory: scan_directories) {
+        if(is_in_directory(*it, directory)) {
+          scanned=true;
+          break;
+        }
+      }
+      if(scanned) {
+        scanned_changed_directories.emplace_back(*it);
+        it=changed_status_directories.erase(it);
+      }
+      else
+        ++it;
+    }
+    auto generation=saved_status_generation;
+    lock.unlock();
+    
+    git_status_options options;
+    git_status_init_options(&options, GIT_STATUS_OPTIONS_VERSION);
+    options.show=GIT_STATUS_SHOW_INDEX_AND_WORKDIR;
+    options.flags=GIT_STATUS_OPT_INCLUDE_UNTRACKED | GIT_STATUS_OPT_RECURSE_UNTRACKED_DIRS; // Ignored files are not needed
+    std::vector<char *> pathspec;
+    if(scan_directories.count("")==0) {
+      // The directories are literal paths, which otherwise would be matched as patterns if they contain for instance * or [
+      options.flags|=GIT_STATUS_OPT_DISABLE_PATHSPEC_MATCH;
+      for(auto &directory: scan_directories)
+        pathspec.emplace_back(const_cast<char *>(directory.c_str()));
+      options.pathspec.strings=pathspec.data();
+      options.pathspec.count=pathspec.size();
+    }
+    std::function<void(const char *path, STATUS status)> callback=[&files](const char *path_cstr, STATUS status) {
+      if(status==STATUS::NEW || status==STATUS::UNTRACKED || status==STATUS::MODIFIED)
+        files.emplace(path_cstr, status);
+    };
+    std::string error_message;
+    try {
+      // A separate repository handle is used for status scans, so that other operations on the repository are not blocked during scans
+      if(!status_repository)
+        status_repository=open(work_path);
+      Error error;
+      error.code=git_status_foreach_ext(status_repository.get(), &options, status_callback, &callback);
+      if(error)
+        error_message=error.message();
+    }
+    catch(const std::exception &e) {
+      error_message=e.what();
+    }
+    
+    lock.lock();
+    if(!error_message.empty()) {
+      if(generation==saved_status_generation) {
+        for(auto &directory: scanned_changed_directories)
+          changed_status_directories.emplace(directory);
+      }
+      throw std::runtime_error(error_message);
+    }
+    if(generation==saved_status_generation) {
+      for(auto &directory: scan_directories) {
+        if(directory.empty())
+          saved_status_files.clear();
+        else {
+          saved_status_files.erase(directory);
+          for(auto it=saved_status_files.lower_bound(directory+'/');it!=saved_status_files.end() && is_in_directory(it->first, directory);)
+            it=saved_status_files.erase(it);
+        }
+        for(auto it=saved_status_directories.begin();it!=saved_status_directories.end();) {
+          if(is_in_directory(*it, directory))
+            it=saved_status_directories.erase(it);
+          else
+            ++it;
+        }
+        saved_status_directories.emplace(directory);
+      }
+      for(auto &file: files)
+        saved_status_files[file.first]=file.second;
+      saved_status=nullptr;
+    }
+    else // All saved status was cleared during the scan
+      return create_status(files);
+  }
+  
+  if(!saved_status)
+    saved_status=create_status(saved_status_files);
+  return saved_status;
+}
+
+std::shared_ptr<const Git::Repository::Status> Git::Repository::create_status(const std::map<std::string, STATUS> &files) {
+  auto status=std::make_shared<Status>();
+  status->work_path=work_path;
+  for(auto &file: files)
+    status->add(file.first, file.second);
   return status;
 }
 
+void Git::Repository::Status::add(const std::string &path, STATUS status) {
+  bool modified=status==STATUS::MODIFIED;
+  bool added=status==STATUS::NEW || status==STATUS::UNTRACKED;
+  if(modified)
+    ++modified_count;
+  else if(status==STATUS::NEW)
+    ++new_count;
+  else if(status==STATUS::UNTRACKED)
+    ++untracked_count;
+  
+  auto node=&root;
+  size_t start=0;
+  while(true) {
+    node->modified=node->modified || modified;
+    node->added=node->added || added;
+    if(start>=path.size())
+      break;
+    auto end=path.find('/', start);
+    if(end==std::string::npos)
+      end=path.size();
+    auto &child=node->children[path.substr(start, end-start)];
+    if(!child)
+      child=std::make_unique<Node>();
+    node=child.get();
+    start=end+1;
+  }
+  node->status=status;
+}
+
+const Git::Repository::Status::Node *Git::Repository::Status::find(const boost::filesystem::path &path) const noexcept {
+  auto path_string=path.generic_string();
+  auto work_path_string=work_path.generic_string();
+  if(path_string.size()<work_path_string.size() || path_string.compare(0, work_path_string.size(), work_path_string)!=0 ||
+     (path_string.size()>work_path_string.size() && path_string[work_path_string.size()]!='/'))
+    return nullptr;
+  auto node=&root;
+  size_t start=work_path_string.size();
+  while(start<path_string.size()) {
+    if(path_string[start]=='/') {
+      ++start;
+      continue;
+    }
+    auto end=path_string.find('/', start);
+    if(end==std::string::npos)
+      end=path_string.size();
+    auto it=node->children.find(path_string.substr(start, end-start));
+    if(it==node->children.end())
+      return nullptr;
+    node=it->second.get();
+    start=end;
+  }
+  return node;
+}
+
+bool Git::Repository::Status::is_modified(const boost::filesystem::path &path) const noexcept {
+  auto node=find(path);
+  return node && node->modified;
+}
+
+bool Git::Repository::Status::is_added(const boost::filesystem::path &path) const noexcept {
+  auto node=find(path);
+  return node && node->added;
+}
+
+void Git::Repository::Status::for_each(const std::function<void(const std::string &path, STATUS status)> &function) const {
+  std::function<void(const Node &, const std::string &)> for_each_node=[&function, &for_each_node](const Node &node, const std::string &path) {
+    if(node.children.empty()) {
+      if(!path.empty())
+        function(path, node.status);
+      return;
+    }
+    for(auto &child: node.children)
+      for_each_node(*child.second, path.empty() ? child.first : path+'/'+child.first);
+  };
+  for_each_node(root, "");
+}
+
 void Git::Repository::clear_saved_status() {
   std::unique_lock<std::mutex> lock(saved_status_mutex);
-  saved_status.added.clear();
-  saved_status.modified.clear();
-  has_saved_status=false;
+  saved_status_files.clear();
+  saved_status_directories.clear();
+  changed_status_directories.clear();
+  ++saved_status_generation;
+  saved_status=nullptr;
+}
+
+void Git::Repository::clear_saved_status(const boost::filesystem::path &directory) {
+  std::string relative_directory;
+  if(!get_relative_path(directory, relative_directory))
+    return;
+  std::unique_lock<std::mutex> lock(saved_status_mutex);
+  changed_status_directories.emplace(relative_directory);
 }
 
 boost::filesystem::path Git::Repository::get_work_path() noexcept {
-  std::lock_guard<std::mutex> lock(mutex);
-  return Git::path(git_repository_workdir(repository.get()));
+  return work_path;
 }
 
 boost::filesystem::path Git::Repository::get_path() noexcept {
-  std::lock_guard<std::mutex> lock(mutex);
-  return Git::path(git_repository_path(repository.get()));
+  return git_path;
 }
 
 boost::filesystem::path Git::Repository::get_root_path(const boost::filesystem::path &path) {
@@ -227,7 +574,6 @@ boost::filesystem::path Git::Repository::get_root_path(const boost::filesystem::
   git_buf root = {nullptr, 0, 0};
   {
     Error error;
-    std::lock_guard<std::mutex> lock(mutex);
     error.code = git_repository_discover(&root, path.generic_string().c_str(), 0, nullptr);
     if(error)
       throw std::runtime_error(error.message());
@@ -237,13 +583,152 @@ boost::filesystem::path Git::Repository::get_root_path(const boost::filesystem::
   return root_path;
 }
 
-Git::Repository::Diff Git::Repository::get_diff(const boost::filesystem::path &path) {
-  return Diff(path, repository.get());
+std::shared_ptr<Git::Repository::Diff> Git::Repository::get_diff(const boost::filesystem::path &path) {
+  auto path_string=path.generic_string();
+  std::lock_guard<std::mutex> lock(mutex);
+  
+  Error error;
+  git_oid head_id;
+  error.code=git_reference_name_to_id(&head_id, repository.get(), "HEAD");
+  if(error.code==GIT_ENOTFOUND) // No commits yet
+    return nullptr;
+  if(error)
+    throw std::runtime_error(error.message());
+  auto it=diffs.find(path_string);
+  if(it!=diffs.end() && git_oid_equal(&it->second.head_id, &head_id))
+    return it->second.diff;
+  
+  git_oid blob_id;
+  {
+    git_commit *commit;
+    error.code=git_commit_lookup(&commit, repository.get(), &head_id);
+    if(error)
+      throw std::runtime_error(error.message());
+    git_tree *tree;
+    error.code=git_commit_tree(&tree, commit);
+    git_commit_free(commit);
+    if(error)
+      throw std::runtime_error(error.message());
+    git_tree_entry *entry;
+    error.code=git_tree_entry_bypath(&entry, tree, path_string.c_str());
+    git_tree_free(tree);
+    if(error) {
+      if(it!=diffs.end())
+        diffs.erase(it);
+      if(error.code==GIT_ENOTFOUND)
+        return nullptr;
+      throw std::runtime_error(error.message());
+    }
+    bool is_blob=git_tree_entry_type(entry)==GIT_OBJ_BLOB;
+    git_oid_cpy(&blob_id, git_tree_entry_id(entry));
+    git_tree_entry_free(entry);
+    if(!is_blob)
+      throw std::runtime_error(path_string+" is not a file");
+  }
+  // For instance after a commit that did not change this file
+  if(it!=diffs.end() && git_oid_equal(&it->second.blob_id, &blob_id)) {
+    git_oid_cpy(&it->second.head_id, &head_id);
+    return it->second.diff;
+  }
+  
+  git_blob *blob;
+  error.code=git_blob_lookup(&blob, repository.get(), &blob_id);
+  if(error)
+    throw std::runtime_error(error.message());
+  std::shared_ptr<Diff> diff(new Diff(blob));
+  
+  // Remove diffs that are no longer in use
+  for(auto cached_it=diffs.begin();cached_it!=diffs.end();) {
+    if(cached_it->second.diff.use_count()==1)
+      cached_it=diffs.erase(cached_it);
+    else
+      ++cached_it;
+  }
+  auto &cached_diff=diffs[path_string];
+  cached_diff.head_id=head_id;
+  cached_diff.blob_id=blob_id;
+  cached_diff.diff=diff;
+  return diff;
+}
+
+std::shared_ptr<const Git::Repository::Blame> Git::Repository::get_blame(const boost::filesystem::path &path, const boost::filesystem::path &cache_directory) {
+  auto path_string=path.generic_string();
+  std::lock_guard<std::mutex> lock(blame_mutex);
+  if(!blame_repository)
+    blame_repository=open(work_path);
+  
+  Error error;
+  git_oid head_id;
+  error.code=git_reference_name_to_id(&head_id, blame_repository.get(), "HEAD");
+  if(error)
+    throw std::runtime_error(error.message());
+  auto it=blames.find(path_string);
+  if(it!=blames.end() && git_oid_equal(&it->second.first, &head_id))
+    return it->second.second;
+  
+  auto blame=std::make_shared<Blame>();
+  
+  boost::filesystem::path cache_path;
+  if(!cache_directory.empty()) {
+    char head_id_cstr[GIT_OID_HEXSZ+1];
+    git_oid_tostr(head_id_cstr, sizeof(head_id_cstr), &head_id);
+    cache_path=cache_directory/(std::string(head_id_cstr)+'-'+std::to_string(std::hash<std::string>()(path_string)));
+    std::ifstream stream(cache_path.string());
+    if(stream && blame->read(stream)) {
+      // The modification time marks the blame as recently used for prune_cache()
+      boost::system::error_code ec;
+      boost::filesystem::last_write_time(cache_path, std::time(nullptr), ec);
+      blames[path_string]={head_id, blame};
+      return blame;
+    }
+    blame->hunks.clear();
+  }
+  
+  git_blame_options options;
+  git_blame_init_options(&options, GIT_BLAME_OPTIONS_VERSION);
+  git_oid_cpy(&options.newest_commit, &head_id);
+  git_blame *git_blame_ptr;
+  error.code=git_blame_file(&git_blame_ptr, blame_repository.get(), path_string.c_str(), &options);
+  if(error)
+    throw std::runtime_error(error.message());
+  auto hunk_count=git_blame_get_hunk_count(git_blame_ptr);
+  blame->hunks.reserve(hunk_count);
+  for(uint32_t c=0;c<hunk_count;++c) {
+    auto hunk=git_blame_get_hunk_byindex(git_blame_ptr, c);
+    char commit_id_cstr[GIT_OID_HEXSZ+1];
+    git_oid_tostr(commit_id_cstr, sizeof(commit_id_cstr), &hunk->final_commit_id);
+    blame->hunks.emplace_back();
+    auto &blame_hunk=blame->hunks.back();
+    blame_hunk.lines={static_cast<int>(hunk->final_start_line_number)-1, static_cast<int>(hunk->lines_in_hunk)};
+    blame_hunk.commit_id=commit_id_cstr;
+    if(hunk->final_signature) {
+      blame_hunk.author=hunk->final_signature->name;
+      blame_hunk.time=hunk->final_signature->when.time;
+    }
+    else
+      blame_hunk.time=0;
+  }
+  git_blame_free(git_blame_ptr);
+  
+  if(!cache_path.empty()) {
+    boost::system::error_code ec;
+    boost::filesystem::create_directories(cache_directory, ec);
+    std::ofstream stream(cache_path.string());
+    if(stream) {
+      blame->write(stream);
+      stream.close();
+      Blame::prune_cache(cache_directory, 1000);
+    }
+  }
+  
+  blames[path_string]={head_id, blame};
+  return blame;
 }
 
 std::string Git::Repository::get_branch() noexcept {
   std::string branch;
   git_reference *reference;
+  std::lock_guard<std::mutex> lock(mutex);
   if(git_repository_head(&reference, repository.get())==0) {
     if(auto reference_name_cstr=git_reference_name(reference)) {
       std::string reference_name(reference_name_cstr);
@@ -270,13 +755,53 @@ void Git::initialize() noexcept {
   }
 }
 
+boost::filesystem::path Git::get_cached_root_path(const boost::filesystem::path &directory) {
+  std::lock_guard<std::mutex> lock(root_paths_mutex);
+  // Walk up to the closest directory that has been looked up before, which gives the answer
+  // unless one of the directories in between is a repository
+  std::vector<std::string> directories;
+  boost::filesystem::path root_path;
+  bool found=false;
+  for(auto path=directory;!path.empty();path=path.parent_path()) {
+    auto path_string=path.generic_string();
+    auto it=root_paths.find(path_string);
+    if(it!=root_paths.end()) {
+      root_path=it->second;
+      found=true;
+      break;
+    }
+    directories.emplace_back(std::move(path_string));
+    boost::system::error_code ec;
+    if(boost::filesystem::exists(path/".git", ec))
+      break;
+    if(path==path.root_path())
+      break;
+  }
+  if(!found) {
+    try {
+      root_path=Repository::get_root_path(directory);
+    }
+    catch(const std::exception &) {}
+  }
+  for(auto &directory: directories)
+    root_paths.emplace(directory, root_path);
+  return root_path;
+}
+
+void Git::clear_root_paths() {
+  std::lock_guard<std::mutex> lock(root_paths_mutex);
+  root_paths.clear();
+}
+
 std::shared_ptr<Git::Repository> Git::get_repository(const boost::filesystem::path &path) {
   initialize();
   static std::unordered_map<std::string, std::weak_ptr<Git::Repository> > cache;
   static std::mutex mutex;
   
   std::lock_guard<std::mutex> lock(mutex);
-  auto root_path=Repository::get_root_path(path).generic_string();
+  auto root_path=get_cached_root_path(path).generic_string();
+  if(root_path.empty())
+    return nullptr;
   auto it=cache.find(root_path);
   if(it==cache.end())
     it=cache.emplace(root_path, std::weak_ptr<Git::Repository>()).first;
@@ -2,7 +2,10 @@
 #include <git2.h>
 #include <mutex>
 #include <memory>
+#include <ctime>
 #include <iostream>
+#include <map>
+#include <set>
 #include <unordered_set>
 #include <unordered_map>
 #include <vector>
@@ -24,12 +27,6 @@ public:
   public:
     class Diff {
     public:
-      class Lines {
-      public:
-        std::vector<std::pair<int, int> > added;
-        std::vector<std::pair<int, int> > modified;
-        std::vector<int> removed;
-      };
       class Hunk {
       public:
         Hunk(int old_start, int old_size, int new_start, int new_size): old_lines(old_start, old_size), new_lines(new_start, new_size) {}
@@ -40,50 +37,156 @@ public:
       };
     private:
       friend class Repository;
-      Diff(const boost::filesystem::path &path, git_repository *repository);
-      git_repository *repository=nullptr;
+      Diff(git_blob *blob);
       std::shared_ptr<git_blob> blob=nullptr;
-      git_diff_options options;
-      static int hunk_cb(const git_diff_delta *delta, const git_diff_hunk *hunk, void *payload) noexcept;
-      static int line_cb(const git_diff_delta *delta, const git_diff_hunk *hunk, const git_diff_line *line, void *payload) noexcept;
+      std::vector<size_t> line_hashes;
+      /// Offsets of the lines in blob
+      std::vector<size_t> line_offsets;
     public:
-      Lines get_lines(const std::string &buffer);
       static std::vector<Hunk> get_hunks(const std::string &old_buffer, const std::string &new_buffer);
-      std::string get_details(const std::string &buffer, int line_nr);
+      /// Line based diff using line hashes. The hunk line numbers are 0-based,
+      /// and the start of an empty range is the line that follows it.
+      static std::vector<Hunk> get_hunks(const std::vector<size_t> &old_line_hashes, const std::vector<size_t> &new_line_hashes);
+      
+      /// Line hashes of the file in HEAD
+      const std::vector<size_t> &get_line_hashes() noexcept { return line_hashes; }
+      /// Returns the text, including line endings, of the given 0-based start line and number of lines in the file in HEAD
+      std::string get_text(const std::pair<int, int> &lines);
+      /// Hashes of the lines in text, excluding line endings. Text ending with a newline has an empty last line.
+      static std::vector<size_t> get_line_hashes(const char *text, size_t size);
+      static size_t get_line_hash(const char *line, size_t size);
     };
     
-    enum class STATUS {CURRENT, NEW, MODIFIED, DELETED, RENAMED, TYPECHANGE, UNREADABLE, IGNORED, CONFLICTED};
+    class Blame {
+    public:
+      class Hunk {
+      public:
+        /// 0-based start line and number of lines, in the file in HEAD
+        std::pair<int, int> lines;
+        std::string commit_id;
+        std::string author;
+        std::time_t time;
+      };
+      /// Ordered by line
+      std::vector<Hunk> hunks;
+      
+      /// Returns the hunk index of a line in the file in HEAD, or -1 if not found
+      int get_hunk_index(int line) const noexcept;
+      
+      void write(std::ostream &stream) const;
+      /// Returns false if the stream does not contain a valid blame
+      bool read(std::istream &stream);
+      /// Removes the least recently used blames in cache_directory when there are more than max_files
+      static void prune_cache(const boost::filesystem::path &cache_directory, size_t max_files);
+    };
+    
+    enum class STATUS {CURRENT, NEW, UNTRACKED, MODIFIED, DELETED, RENAMED, TYPECHANGE, UNREADABLE, IGNORED, CONFLICTED};
+    /// New, untracked and modified files, stored as a tree of path components
     class Status {
     public:
-      std::unordered_set<std::string> added;
-      std::unordered_set<std::string> modified;
+      class Node {
+      public:
+        std::map<std::string, std::unique_ptr<Node>> children;
+        /// Status of a file
+        STATUS status=STATUS::CURRENT;
+        /// True if the file, or a file in the directory, is modified
+        bool modified=false;
+        /// True if the file, or a file in the directory, is new or untracked
+        bool added=false;
+      };
+      
+      boost::filesystem::path work_path;
+      Node root;
+      size_t modified_count=0;
+      size_t new_count=0;
+      size_t untracked_count=0;
+      
+      bool is_modified(const boost::filesystem::path &path) const noexcept;
+      /// Returns true if path is new or untracked, or is a directory containing new or untracked files
+      bool is_added(const boost::filesystem::path &path) const noexcept;
+      /// Calls function with the path, relative to the work path, and status of each file, ordered by path
+      void for_each(const std::function<void(const std::string &path, STATUS status)> &function) const;
+      /// Adds a file with a path relative to the work path
+      void add(const std::string &path, STATUS status);
+      
+    private:
+      /// Returns nullptr if path has no changes
+      const Node *find(const boost::filesystem::path &path) const noexcept;
     };
   private:
     friend class Git;
     Repository(const boost::filesystem::path &path);
     
     static int status_callback(const char *path, unsigned int status_flags, void *data) noexcept;
+    /// Returns true if path, relative to the work path, is directory or inside directory. The empty string is the work path.
+    static bool is_in_directory(const std::string &path, const std::string &directory) noexcept;
+    /// Returns false if path is not inside the work path
+    bool get_relative_path(const boost::filesystem::path &path, std::string &relative_path) noexcept;
+    std::shared_ptr<const Status> create_status(const std::map<std::string, STATUS> &files);
+    
+    static std::unique_ptr<git_repository, std::function<void(git_repository *)> > open(const boost::filesystem::path &path);
     
     std::unique_ptr<git_repository, std::function<void(git_repository *)> > repository;
+    /// Protects repository. A repository object can be used from several threads, but not concurrently.
+    std::mutex mutex;
+    /// Repository handle used in status scans, protected by status_scan_mutex
+    std::unique_ptr<git_repository, std::function<void(git_repository *)> > status_repository;
     
+    boost::filesystem::path git_path;
     boost::filesystem::path work_path;
     sigc::connection monitor_changed_connection;
-    Status saved_status;
-    bool has_saved_status=false;
+    /// New and modified files, relative to the work path, found in saved_status_directories
+    std::map<std::string, STATUS> saved_status_files;
+    /// Directories, relative to the work path, that have been scanned
+    std::set<std::string> saved_status_directories;
+    /// Directories, relative to the work path, with changes since they were scanned
+    std::set<std::string> changed_status_directories;
+    /// Incremented when all saved status is cleared
+    size_t saved_status_generation=0;
+    /// Status of saved_status_files, created when needed
+    std::shared_ptr<const Status> saved_status;
     std::mutex saved_status_mutex;
+    /// Held during status scans, so that concurrent calls to get_status() wait for, and reuse, the scan in progress
+    std::mutex status_scan_mutex;
+    
+    class CachedDiff {
+    public:
+      git_oid head_id;
+      git_oid blob_id;
+      std::shared_ptr<Diff> diff;
+    };
+    /// Diffs of files in HEAD by path relative to the work path, protected by mutex.
+    /// A diff is reused until the tree entry of its file changes.
+    std::unordered_map<std::string, CachedDiff> diffs;
+    
+    /// Repository handle used by get_blame(), since blaming can take a while. Protected by blame_mutex.
+    std::unique_ptr<git_repository, std::function<void(git_repository *)> > blame_repository;
+    std::mutex blame_mutex;
+    /// Blames of files in HEAD by path relative to the work path, and the HEAD they were made from. Protected by blame_mutex.
+    std::unordered_map<std::string, std::pair<git_oid, std::shared_ptr<const Blame>>> blames;
   public:
     ~Repository();
     
     static std::string status_string(STATUS status) noexcept;
     
-    Status get_status();
+    /// Returns the status of the files in the given directories, or in the whole work tree if directories is empty.
+    /// Only directories that have not been scanned, or that have changed, are scanned.
+    /// The returned status can also contain saved status from other directories, and is shared by the callers until the status changes.
+    std::shared_ptr<const Status> get_status(const std::vector<boost::filesystem::path> &directories={});
     void clear_saved_status();
+    /// Clears the saved status of a directory whose files have changed
+    void clear_saved_status(const boost::filesystem::path &directory);
     
     boost::filesystem::path get_work_path() noexcept;
     boost::filesystem::path get_path() noexcept;
     static boost::filesystem::path get_root_path(const boost::filesystem::path &path);
     
-    Diff get_diff(const boost::filesystem::path &path);
+    /// Returns the diff of a file, relative to the work path, against HEAD, or nullptr if the file is not in HEAD.
+    /// The same diff is returned as long as the file in HEAD is unchanged.
+    std::shared_ptr<Diff> get_diff(const boost::filesystem::path &path);
+    /// Returns the blame of a file, relative to the work path, in HEAD. Blames are cached per HEAD and path,
+    /// and are also saved in cache_directory if it is not empty.
+    std::shared_ptr<const Blame> get_blame(const boost::filesystem::path &path, const boost::filesystem::path &cache_directory={});
     
     std::string get_branch() noexcept;
     
@@ -93,13 +196,22 @@ public:
 private:
   static bool initialized;
   
-  ///Mutex for thread safe operations
+  ///Mutex for initialize()
   static std::mutex mutex;
   
   ///Call initialize in public static methods
   static void initialize() noexcept;
   
   static boost::filesystem::path path(const char *cpath, size_t cpath_length=static_cast<size_t>(-1)) noexcept;
+  
+  /// Git paths of the repositories containing the directories looked up in get_repository(), and an empty path for directories outside of repositories
+  static std::unordered_map<std::string, boost::filesystem::path> root_paths;
+  static std::mutex root_paths_mutex;
+  /// Returns the git path of the repository containing directory using root_paths, or an empty path if there is none
+  static boost::filesystem::path get_cached_root_path(const boost::filesystem::path &directory);
 public:
+  /// Returns nullptr if path is not in a repository
   static std::shared_ptr<Repository> get_repository(const boost::filesystem::path &path);
+  /// Clears the saved repository lookups, for instance when a .git directory is created or removed
+  static void clear_root_paths();
 };
@@ -229,6 +229,14 @@ const Glib::ustring menu_xml= R"RAW(<interface>
             <attribute name='label' translatable='yes'>_Show _Diff</attribute>
             <attribute name='action'>app.source_git_show_diff</attribute>
           </item>
+          <item>
+            <attribute name='label' translatable='yes'>_Changed _Files</attribute>
+            <attribute name='action'>app.source_git_changed_files</attribute>
+          </item>
+          <item>
+            <attribute name='label' translatable='yes'>_Toggle _Blame</attribute>
+            <attribute name='action'>app.source_git_toggle_blame</attribute>
+          </item>
         </submenu>
       </section>
       <section>
@@ -349,6 +357,22 @@ const Glib::ustring menu_xml= R"RAW(<interface>
           <attribute name='label' translatable='yes'>_Compile</attribute>
           <attribute name='action'>app.project_compile</attribute>
         </item>
+        <item>
+          <attribute name='label' translatable='yes'>_Compile _Current _File</attribute>
+          <attribute name='action'>app.project_compile_file</attribute>
+        </item>
+        <item>
+          <attribute name='label' translatable='yes'>_Check _Syntax _of _Current _File</attribute>
+          <attribute name='action'>app.project_check_file_syntax</attribute>
+        </item>
+        <item>
+          <attribute name='label' translatable='yes'>_Cancel _Build</attribute>
+          <attribute name='action'>app.project_cancel_build</attribute>
+        </item>
+        <item>
+          <attribute name='label' translatable='yes'>_Show _Build _Diagnostics</attribute>
+          <attribute name='action'>app.project_show_build_diagnostics</attribute>
+        </item>
         <item>
           <attribute name='label' translatable='yes'>_Recreate _Build</attribute>
           <attribute name='action'>app.project_recreate_build</attribute>
@@ -5,6 +5,10 @@
 #include "terminal.h"
 #include "dialogs.h"
 #include "config.h"
+#include <boost/property_tree/json_parser.hpp>
+
+std::unordered_map<std::string, std::tuple<std::time_t, boost::uintmax_t, std::shared_ptr<Meson::Targets>>> Meson::targets_cache;
+std::mutex Meson::targets_cache_mutex;
 
 Meson::Meson(const boost::filesystem::path &path) {
   const auto find_project=[](const boost::filesystem::path &file_path) {
@@ -32,16 +36,22 @@ Meson::Meson(const boost::filesystem::path &path) {
   }
 }
 
-bool Meson::update_default_build(const boost::filesystem::path &default_build_path, bool force) {
+bool Meson::update_default_build(const boost::filesystem::path &default_build_path, bool force, const std::function<void(int exit_status)> &on_exit) {
+  auto failed=[&on_exit] {
+    if(on_exit)
+      on_exit(-1);
+    return false;
+  };
+  
   if(project_path.empty() || !boost::filesystem::exists(project_path/"meson.build") || default_build_path.empty())
-      return false;
+    return failed();
   
   if(!boost::filesystem::exists(default_build_path)) {
     boost::system::error_code ec;
     boost::filesystem::create_directories(default_build_path, ec);
     if(ec) {
       Terminal::get().print("Error: could not create "+default_build_path.string()+": "+ec.message()+"\n", true);
-      return false;
+      return failed();
     }
   }
   
@@ -50,25 +60,37 @@ bool Meson::update_default_build(const boost::filesystem::path &default_build_pa
   if(!force && compile_commands_exists)
     return true;
   
+  auto command=Config::get().project.meson.command+' '+(compile_commands_exists?"--internal regenerate ":"")+filesystem::escape_argument(project_path.string());
+  if(on_exit) {
+    Terminal::get().print("Creating/updating default build in "+filesystem::get_short_path(default_build_path).string()+"\n");
+    Terminal::get().async_process(command, default_build_path, on_exit, false, true);
+    return false;
+  }
+  
   Dialog::Message message("Creating/updating default build");
-  auto exit_status=Terminal::get().process(Config::get().project.meson.command+' '+(compile_commands_exists?"--internal regenerate ":"")+
-                                           filesystem::escape_argument(project_path.string()), default_build_path);
+  auto exit_status=Terminal::get().process(command, default_build_path);
   message.hide();
   if(exit_status==EXIT_SUCCESS)
     return true;
   return false;
 }
 
-bool Meson::update_debug_build(const boost::filesystem::path &debug_build_path, bool force) {
-  if(project_path.empty() || !boost::filesystem::exists(project_path/"meson.build") || debug_build_path.empty())
+bool Meson::update_debug_build(const boost::filesystem::path &debug_build_path, bool force, const std::function<void(int exit_status)> &on_exit) {
+  auto failed=[&on_exit] {
+    if(on_exit)
+      on_exit(-1);
     return false;
+  };
+  
+  if(project_path.empty() || !boost::filesystem::exists(project_path/"meson.build") || debug_build_path.empty())
+    return failed();
   
   if(!boost::filesystem::exists(debug_build_path)) {
     boost::system::error_code ec;
     boost::filesystem::create_directories(debug_build_path, ec);
     if(ec) {
       Terminal::get().print("Error: could not create "+debug_build_path.string()+": "+ec.message()+"\n", true);
-      return false;
+      return failed();
     }
   }
   
@@ -76,9 +98,16 @@ bool Meson::update_debug_build(const boost::filesystem::path &debug_build_path,
   if(!force && compile_commands_exists)
     return true;
   
+  auto command=Config::get().project.meson.command+' '+(compile_commands_exists?"--internal regenerate ":"")+
+               "--buildtype debug "+filesystem::escape_argument(project_path.string());
+  if(on_exit) {
+    Terminal::get().print("Creating/updating debug build in "+filesystem::get_short_path(debug_build_path).string()+"\n");
+    Terminal::get().async_process(command, debug_build_path, on_exit, false, true);
+    return false;
+  }
+  
   Dialog::Message message("Creating/updating debug build");
-  auto exit_status=Terminal::get().process(Config::get().project.meson.command+' '+(compile_commands_exists?"--internal regenerate ":"")+
-                                           "--buildtype debug "+filesystem::escape_argument(project_path.string()), debug_build_path);
+  auto exit_status=Terminal::get().process(command, debug_build_path);
   message.hide();
   if(exit_status==EXIT_SUCCESS)
     return true;
@@ -86,32 +115,74 @@ bool Meson::update_debug_build(const boost::filesystem::path &debug_build_path,
 }
 
 boost::filesystem::path Meson::get_executable(const boost::filesystem::path &build_path, const boost::filesystem::path &file_path) {
+  if(auto targets=get_targets(build_path))
+    return targets->find(file_path);
+  
   CompileCommands compile_commands(build_path);
   
-  size_t best_match_size=-1;
-  boost::filesystem::path best_match_executable;
+  SourceExecutables source_executables;
   for(auto &command: compile_commands.commands) {
-    auto command_file=filesystem::get_normal_path(command.file);
     auto values=command.parameter_values("-o");
     if(!values.empty()) {
       size_t pos;
       if((pos=values[0].find('@'))!=std::string::npos) {
-        if(pos+1<values[0].size() && values[0].compare(pos+1, 3, "exe")==0) {
-          auto executable=build_path/values[0].substr(0, pos);
-          if(command_file==file_path)
-            return executable;
-          auto command_file_directory=command_file.parent_path();
-          if(filesystem::file_in_path(file_path, command_file_directory)) {
-            auto size=static_cast<size_t>(std::distance(command_file_directory.begin(), command_file_directory.end()));
-            if(best_match_size==static_cast<size_t>(-1) || best_match_size<size) {
-              best_match_size=size;
-              best_match_executable=executable;
-            }
-          }
+        if(pos+1<values[0].size() && values[0].compare(pos+1, 3, "exe")==0)
+          source_executables.add(filesystem::get_normal_path(command.file), build_path/values[0].substr(0, pos));
+      }
+    }
+  }
+  
+  return source_executables.find(file_path);
+}
+
+std::shared_ptr<Meson::Targets> Meson::get_targets(const boost::filesystem::path &build_path) {
+  // Same as the output of meson introspect --targets, available since Meson 0.50
+  auto targets_path=build_path/"meson-info"/"intro-targets.json";
+  boost::system::error_code ec;
+  auto last_write_time=boost::filesystem::last_write_time(targets_path, ec);
+  if(ec)
+    return nullptr;
+  auto file_size=boost::filesystem::file_size(targets_path, ec);
+  if(ec)
+    return nullptr;
+  
+  std::unique_lock<std::mutex> lock(targets_cache_mutex);
+  auto it=targets_cache.find(build_path.string());
+  if(it!=targets_cache.end() && std::get<0>(it->second)==last_write_time && std::get<1>(it->second)==file_size)
+    return std::get<2>(it->second);
+  lock.unlock();
+  
+  auto targets=std::make_shared<Targets>();
+  try {
+    boost::property_tree::ptree targets_pt;
+    boost::property_tree::json_parser::read_json(targets_path.string(), targets_pt);
+    for(auto &target: targets_pt) {
+      if(target.second.get<std::string>("type")!="executable")
+        continue;
+      auto filenames_pt=target.second.get_child("filename");
+      if(filenames_pt.empty())
+        continue;
+      boost::filesystem::path executable=filenames_pt.begin()->second.get_value<std::string>();
+      if(executable.is_relative())
+        executable=build_path/executable;
+      executable=filesystem::get_normal_path(executable);
+      
+      for(auto &target_source: target.second.get_child("target_sources", boost::property_tree::ptree())) {
+        for(auto &source: target_source.second.get_child("sources", boost::property_tree::ptree())) {
+          boost::filesystem::path source_file=source.second.get_value<std::string>();
+          if(source_file.is_relative())
+            source_file=build_path/source_file;
+          source_file=filesystem::get_normal_path(source_file);
+          targets->add(std::move(source_file), executable);
         }
       }
     }
   }
+  catch(...) {
+    return nullptr;
+  }
   
-  return best_match_executable;
+  lock.lock();
+  targets_cache[build_path.string()]=std::make_tuple(last_write_time, file_size, targets);
+  return targets;
 }
@@ -1,5 +1,12 @@
 #pragma once
+#include "compile_commands.h"
 #include <boost/filesystem.hpp>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <unordered_map>
 #include <vector>
 
 class Meson {
@@ -8,8 +15,23 @@ public:
   
   boost::filesystem::path project_path;
   
-  bool update_default_build(const boost::filesystem::path &default_build_path, bool force=false);
-  bool update_debug_build(const boost::filesystem::path &debug_build_path, bool force=false);
+  /// Returns true if the build is up to date after the call. If on_exit is set, Meson is run in the background instead of
+  /// behind a modal dialog, and on_exit is called with its exit status unless the build was already up to date.
+  bool update_default_build(const boost::filesystem::path &default_build_path, bool force=false, const std::function<void(int exit_status)> &on_exit=nullptr);
+  bool update_debug_build(const boost::filesystem::path &debug_build_path, bool force=false, const std::function<void(int exit_status)> &on_exit=nullptr);
   
   boost::filesystem::path get_executable(const boost::filesystem::path &build_path, const boost::filesystem::path &file_path);
+  
+  /// Executables and their source files from the introspection data that Meson writes to a build directory when configuring
+  using Targets=SourceExecutables;
+  /// Returns nullptr if build_path has no introspection data. The data is read once per configure.
+  /// Only meson-info/intro-targets.json is read. The build options, as from meson introspect --buildoptions,
+  /// are not needed to map source files to executables and are therefore not read.
+  static std::shared_ptr<Targets> get_targets(const boost::filesystem::path &build_path);
+  
+private:
+  /// Targets and the modification time and size of their introspection file, by build path.
+  /// The size is also compared since the modification time only has a resolution of seconds.
+  static std::unordered_map<std::string, std::tuple<std::time_t, boost::uintmax_t, std::shared_ptr<Targets>>> targets_cache;
+  static std::mutex targets_cache_mutex;
 };
@@ -6,6 +6,7 @@
 #include "project.h"
 #include "filesystem.h"
 #include "selection_dialog.h"
+#include "build_diagnostics.h"
 #include "source_clang.h"
 #include "source_language_protocol.h"
 #include "gtksourceview-3.0/gtksourceview/gtksourcemap.h"
@@ -135,26 +136,18 @@ void Notebook::open(const boost::filesystem::path &file_path_, size_t notebook_i
   
   auto language=Source::guess_language(file_path);
   
-  std::string language_protocol_language_id;
-  if(language) {
-    language_protocol_language_id=language->get_id();
-    if(language_protocol_language_id=="js") {
-      if(file_path.extension()==".ts")
-        language_protocol_language_id="typescript";
-      else
-        language_protocol_language_id="javascript";
-    }
-  }
+  auto language_protocol_language_id=LanguageProtocol::get_language_id(file_path, language);
   
   if(language && (language->get_id()=="chdr" || language->get_id()=="cpphdr" || language->get_id()=="c" || language->get_id()=="cpp" || language->get_id()=="objc"))
     source_views.emplace_back(new Source::ClangView(file_path, language));
-  else if(language && !language_protocol_language_id.empty() && !filesystem::find_executable(language_protocol_language_id+"-language-server").empty())
+  else if(!language_protocol_language_id.empty() && !filesystem::find_executable(language_protocol_language_id+"-language-server").empty())
     source_views.emplace_back(new Source::LanguageProtocolView(file_path, language, language_protocol_language_id));
   else
     source_views.emplace_back(new Source::GenericView(file_path, language));
   
   auto source_view=source_views.back();
   source_view->configure();
+  BuildDiagnostics::get().add_markers(source_view);
   
   source_view->scroll_to_cursor_delayed=[this](Source::BaseView* view, bool center, bool show_tooltips) {
     while(Gtk::Main::events_pending())
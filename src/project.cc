@@ -15,12 +15,17 @@
 #include "source_language_protocol.h"
 #include "usages_clang.h"
 #include "ctags.h"
+#include "compile_commands.h"
+#include <algorithm>
 #include <future>
 
 boost::filesystem::path Project::debug_last_stop_file_path;
 std::unordered_map<std::string, std::string> Project::run_arguments;
 std::unordered_map<std::string, Project::DebugRunArguments> Project::debug_run_arguments;
 std::atomic<bool> Project::compiling(false);
+size_t Project::build_process_id=0;
+std::function<void()> Project::build_restart;
+std::mutex Project::build_mutex;
 std::atomic<bool> Project::debugging(false);
 std::pair<boost::filesystem::path, std::pair<int, int> > Project::debug_stop;
 std::string Project::debug_status;
@@ -32,6 +37,58 @@ Gtk::Label &Project::debug_status_label() {
   return label;
 }
 
+Gtk::ProgressBar &Project::build_progress_bar() {
+  static Gtk::ProgressBar progress_bar;
+  return progress_bar;
+}
+
+void Project::start_build(const std::string &message, const std::string &command, const boost::filesystem::path &path, const std::function<void(int exit_status)> &on_exit) {
+  static Dispatcher dispatcher;
+  
+  std::unique_lock<std::mutex> lock(build_mutex);
+  if(compiling) {
+    build_restart=[message, command, path, on_exit] {
+      start_build(message, command, path, on_exit);
+    };
+    Terminal::get().print("Restarting build\n");
+    Terminal::get().kill_async_process(build_process_id);
+    return;
+  }
+  
+  compiling=true;
+  BuildDiagnostics::get().clear();
+  if(Config::get().project.clear_terminal_on_compile)
+    Terminal::get().clear();
+  Terminal::get().print(message);
+  build_process_id=Terminal::get().async_process(command, path, [on_exit](int exit_status) {
+    std::function<void()> restart;
+    {
+      std::unique_lock<std::mutex> lock(build_mutex);
+      compiling=false;
+      std::swap(restart, build_restart);
+    }
+    // A replaced build job might still have succeeded, but should not for instance run its executable
+    if(on_exit && !restart)
+      on_exit(exit_status);
+    dispatcher.post([restart=std::move(restart)] {
+      build_progress_bar().hide();
+      if(restart)
+        restart();
+    });
+  }, false, true);
+}
+
+void Project::cancel_build() {
+  std::unique_lock<std::mutex> lock(build_mutex);
+  build_restart=nullptr;
+  if(!compiling) {
+    Info::get().print("No build in progress");
+    return;
+  }
+  Terminal::get().print("Cancelling build\n");
+  Terminal::get().kill_async_process(build_process_id);
+}
+
 void Project::save_files(const boost::filesystem::path &path) {
   for(size_t c=0;c<Notebook::get().size();c++) {
     auto view=Notebook::get().get_view(c);
@@ -63,19 +120,20 @@ void Project::on_save(size_t index) {
   if(!build_path.empty()) {
     auto build=Build::create(build_path);
     if(dynamic_cast<CMakeBuild*>(build.get()) || dynamic_cast<MesonBuild*>(build.get())) {
-      build->update_default(true);
-      Usages::Clang::erase_all_caches_for_project(build->project_path, build->get_default_path());
-      boost::system::error_code ec;
-      if(boost::filesystem::exists(build->get_debug_path()), ec)
-        build->update_debug(true);
-      
-      for(size_t c=0;c<Notebook::get().size();c++) {
-        auto source_view=Notebook::get().get_view(c);
-        if(auto source_clang_view=dynamic_cast<Source::ClangView*>(source_view)) {
-          if(filesystem::file_in_path(source_clang_view->file_path, build->project_path))
-            source_clang_view->full_reparse_needed=true;
+      // The views are reparsed when the build has been updated in the background
+      build->update_default_async(true, [project_path=build->project_path, default_build_path=build->get_default_path()](bool success) {
+        Usages::Clang::erase_all_caches_for_project(project_path, default_build_path);
+        for(size_t c=0;c<Notebook::get().size();c++) {
+          auto source_view=Notebook::get().get_view(c);
+          if(auto source_clang_view=dynamic_cast<Source::ClangView*>(source_view)) {
+            if(filesystem::file_in_path(source_clang_view->file_path, project_path))
+              source_clang_view->full_reparse_needed=true;
+          }
         }
-      }
+      });
+      boost::system::error_code ec;
+      if(boost::filesystem::exists(build->get_debug_path(), ec))
+        build->update_debug_async(true, nullptr);
     }
   }
 }
@@ -175,6 +233,10 @@ void Project::Base::compile_and_run() {
   Info::get().print("Could not find a supported project");
 }
 
+void Project::Base::compile_file(bool syntax_only) {
+  Info::get().print("Could not find a supported project");
+}
+
 void Project::Base::recreate_build() {
   Info::get().print("Could not find a supported project");
 }
@@ -459,7 +521,7 @@ void Project::LLDB::debug_start() {
         Debug::LLDB::get().start(*run_arguments, *project_path, breakpoints, startup_commands, remote_host);
       });
     }
-  });
+  }, false, true);
 }
 
 void Project::LLDB::debug_continue() {
@@ -791,15 +853,7 @@ void Project::Clang::compile() {
   if(default_build_path.empty() || !build->update_default())
     return;
   
-  compiling=true;
-  
-  if(Config::get().project.clear_terminal_on_compile)
-    Terminal::get().clear();
-  
-  Terminal::get().print("Compiling project "+filesystem::get_short_path(build->project_path).string()+"\n");
-  Terminal::get().async_process(build->get_compile_command(), default_build_path, [](int exit_status) {
-    compiling=false;
-  });
+  start_build("Compiling project "+filesystem::get_short_path(build->project_path).string()+"\n", build->get_compile_command(), default_build_path);
 }
 
 void Project::Clang::compile_and_run() {
@@ -814,6 +868,8 @@ void Project::Clang::compile_and_run() {
   if(run_arguments_it!=run_arguments.end())
     arguments=run_arguments_it->second;
   
+  // Only the executable's target is built when the executable is known
+  auto compile_command=build->get_compile_command();
   if(arguments.empty()) {
     auto view=Notebook::get().get_current_view();
     auto executable=build->get_executable(view?view->file_path:Directories::get().path);
@@ -822,17 +878,11 @@ void Project::Clang::compile_and_run() {
       Terminal::get().print("Solution: either use Project Set Run Arguments, or open a source file within a directory where an executable is defined.\n", true);
       return;
     }
+    compile_command=build->get_target_compile_command(executable);
     arguments=filesystem::escape_argument(filesystem::get_short_path(executable).string());
   }
   
-  compiling=true;
-  
-  if(Config::get().project.clear_terminal_on_compile)
-    Terminal::get().clear();
-  
-  Terminal::get().print("Compiling and running "+arguments+"\n");
-  Terminal::get().async_process(build->get_compile_command(), default_build_path, [arguments, project_path](int exit_status){
-    compiling=false;
+  start_build("Compiling and running "+arguments+"\n", compile_command, default_build_path, [arguments, project_path](int exit_status){
     if(exit_status==EXIT_SUCCESS) {
       Terminal::get().async_process(arguments, project_path, [arguments](int exit_status){
         Terminal::get().async_print(arguments+" returned: "+std::to_string(exit_status)+'\n');
@@ -841,6 +891,37 @@ void Project::Clang::compile_and_run() {
   });
 }
 
+void Project::Clang::compile_file(bool syntax_only) {
+  auto view=Notebook::get().get_current_view();
+  if(!view)
+    return;
+  auto default_build_path=build->get_default_path();
+  if(default_build_path.empty() || !build->update_default())
+    return;
+  
+  auto file_path=view->file_path;
+  CompileCommands compile_commands(default_build_path);
+  auto it=std::find_if(compile_commands.commands.begin(), compile_commands.commands.end(), [&file_path](const CompileCommands::Command &command) {
+    return filesystem::get_normal_path(command.file)==file_path;
+  });
+  if(it==compile_commands.commands.end()) {
+    Info::get().print(file_path.filename().string()+" was not found in the compilation database");
+    return;
+  }
+  
+  if(Config::get().project.clear_terminal_on_compile)
+    Terminal::get().clear();
+  
+  // Diagnostics from the compiler replace the diagnostics of the file's view until it is parsed again
+  BuildDiagnostics::get().begin_file_check(file_path);
+  auto short_path=filesystem::get_short_path(file_path).string();
+  Terminal::get().print((syntax_only?"Checking syntax of ":"Compiling ")+short_path+"\n");
+  auto directory=it->directory.is_absolute()?it->directory:default_build_path/it->directory;
+  Terminal::get().async_process(it->get_file_command(syntax_only), directory, [syntax_only, short_path](int exit_status) {
+    Terminal::get().async_print(std::string(syntax_only?"Syntax check":"Compilation")+" of "+short_path+(exit_status==EXIT_SUCCESS?" succeeded\n":" failed\n"));
+  }, false, true);
+}
+
 void Project::Clang::recreate_build() {
   if(build->project_path.empty())
     return;
@@ -879,22 +960,22 @@ void Project::Clang::recreate_build() {
     }
   }
   
-  build->update_default(true);
-  if(has_debug_build)
-    build->update_debug(true);
-  
-  for(size_t c=0;c<Notebook::get().size();c++) {
-    auto source_view=Notebook::get().get_view(c);
-    if(auto source_clang_view=dynamic_cast<Source::ClangView*>(source_view)) {
-      if(filesystem::file_in_path(source_clang_view->file_path, build->project_path))
-        source_clang_view->full_reparse_needed=true;
+  build->update_default_async(true, [project_path=build->project_path](bool success) {
+    for(size_t c=0;c<Notebook::get().size();c++) {
+      auto source_view=Notebook::get().get_view(c);
+      if(auto source_clang_view=dynamic_cast<Source::ClangView*>(source_view)) {
+        if(filesystem::file_in_path(source_clang_view->file_path, project_path))
+          source_clang_view->full_reparse_needed=true;
+      }
     }
-  }
-  
-  if(auto view=Notebook::get().get_current_view()) {
-    if(view->full_reparse_needed)
-      view->full_reparse();
-  }
+    
+    if(auto view=Notebook::get().get_current_view()) {
+      if(view->full_reparse_needed)
+        view->full_reparse();
+    }
+  });
+  if(has_debug_build)
+    build->update_debug_async(true, nullptr);
 }
 
 Project::Markdown::~Markdown() {
@@ -983,31 +1064,15 @@ std::pair<std::string, std::string> Project::Rust::get_run_arguments() {
 }
 
 void Project::Rust::compile() {
-  compiling=true;
-  
-  if(Config::get().project.clear_terminal_on_compile)
-    Terminal::get().clear();
-  
-  Terminal::get().print("Compiling project "+filesystem::get_short_path(build->project_path).string()+"\n");
-  
-  auto command=build->get_compile_command();
-  Terminal::get().async_process(command, build->project_path, [](int exit_status) {
-    compiling=false;
-  });
+  start_build("Compiling project "+filesystem::get_short_path(build->project_path).string()+"\n", build->get_compile_command(), build->project_path);
 }
 
 void Project::Rust::compile_and_run() {
-  compiling=true;
-  
-  if(Config::get().project.clear_terminal_on_compile)
-    Terminal::get().clear();
-  
   auto arguments=get_run_arguments().second;
-  Terminal::get().print("Compiling and running "+arguments+"\n");
+  auto message="Compiling and running "+arguments+"\n";
   
   auto self=this->shared_from_this();
-  Terminal::get().async_process(build->get_compile_command(), build->project_path, [self, arguments=std::move(arguments)](int exit_status) {
-    compiling=false;
+  start_build(message, build->get_compile_command(), build->project_path, [self, arguments=std::move(arguments)](int exit_status) {
     if(exit_status==EXIT_SUCCESS) {
       Terminal::get().async_process(arguments, self->build->project_path, [arguments](int exit_status) {
         Terminal::get().async_print(arguments+" returned: "+std::to_string(exit_status)+'\n');
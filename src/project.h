@@ -2,6 +2,8 @@
 #include <gtkmm.h>
 #include <boost/filesystem.hpp>
 #include <atomic>
+#include <functional>
+#include <mutex>
 #include <unordered_map>
 #include "tooltips.h"
 #include "dispatcher.h"
@@ -23,6 +25,14 @@ namespace Project {
   };
   
   Gtk::Label &debug_status_label();
+  Gtk::ProgressBar &build_progress_bar();
+  /// Runs command in the terminal as the build job, which is shown in the status bar and can be stopped with cancel_build().
+  /// A running build job is cancelled and replaced, and its on_exit is not called. Otherwise, on_exit is called in a background thread when the build job exits.
+  /// The build diagnostics, and the terminal if configured, are cleared and message is printed when the build job starts,
+  /// which is after a cancelled build job has exited.
+  void start_build(const std::string &message, const std::string &command, const boost::filesystem::path &path, const std::function<void(int exit_status)> &on_exit=nullptr);
+  /// Kills the running build job, if any, without affecting other processes
+  void cancel_build();
   void save_files(const boost::filesystem::path &path);
   void on_save(size_t index);
   
@@ -30,6 +40,10 @@ namespace Project {
   extern std::unordered_map<std::string, std::string> run_arguments;
   extern std::unordered_map<std::string, DebugRunArguments> debug_run_arguments;
   extern std::atomic<bool> compiling;
+  /// Terminal process id of the running build job, and the build job to start when it has exited
+  extern size_t build_process_id;
+  extern std::function<void()> build_restart;
+  extern std::mutex build_mutex;
   extern std::atomic<bool> debugging;
   extern std::pair<boost::filesystem::path, std::pair<int, int> > debug_stop;
   extern std::string debug_status;
@@ -52,6 +66,8 @@ namespace Project {
     virtual std::pair<std::string, std::string> get_run_arguments();
     virtual void compile();
     virtual void compile_and_run();
+    /// Compiles only the current file, or only checks its syntax if syntax_only is true
+    virtual void compile_file(bool syntax_only);
     virtual void recreate_build();
     
     virtual void show_symbols();
@@ -114,6 +130,7 @@ namespace Project {
     std::pair<std::string, std::string> get_run_arguments() override;
     void compile() override;
     void compile_and_run() override;
+    void compile_file(bool syntax_only) override;
     void recreate_build() override;    
   };
   
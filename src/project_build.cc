@@ -1,34 +1,106 @@
 #include "project_build.h"
 #include "config.h"
+#include "dispatcher.h"
 #include "filesystem.h"
+#include "info.h"
+#include <algorithm>
+#include <thread>
+#include <unordered_set>
+
+std::unordered_map<std::string, std::shared_ptr<const Project::Build>> Project::Build::cache;
+std::unordered_map<std::string, Glib::RefPtr<Gio::FileMonitor>> Project::Build::monitors;
+std::mutex Project::Build::cache_mutex;
+std::unordered_set<std::string> Project::Build::updating;
 
 std::unique_ptr<Project::Build> Project::Build::create(const boost::filesystem::path &path) {
   auto search_path=boost::filesystem::is_directory(path)?path:path.parent_path();
   
+  std::unique_lock<std::mutex> lock(cache_mutex);
+  auto it=cache.find(search_path.string());
+  if(it!=cache.end())
+    return it->second->clone();
+  lock.unlock();
+  
+  std::unique_ptr<Build> build=find(search_path);
+  
+  // Only builds with monitored build files are cached, since nothing clears the cache when a build file is added
+  if(!build->project_path.empty()) {
+    lock.lock();
+    cache.emplace(search_path.string(), build->clone());
+  }
+  return build;
+}
+
+void Project::Build::clear_cache() {
+  std::unique_lock<std::mutex> lock(cache_mutex);
+  cache.clear();
+}
+
+unsigned Project::Build::get_build_jobs() {
+  if(Config::get().project.build_jobs>0)
+    return Config::get().project.build_jobs;
+  return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+bool Project::Build::update_async(const boost::filesystem::path &build_path, const std::function<bool(const std::function<void(int exit_status)> &on_exit)> &update,
+                                  const std::function<void(bool success)> &on_done) {
+  static Dispatcher dispatcher;
+  
+  auto build_path_string=build_path.string();
+  if(!updating.emplace(build_path_string).second)
+    return false;
+  
+  auto up_to_date=update([build_path_string, on_done](int exit_status) {
+    dispatcher.post([build_path_string, on_done, exit_status] {
+      updating.erase(build_path_string);
+      if(on_done)
+        on_done(exit_status==EXIT_SUCCESS);
+    });
+  });
+  if(up_to_date)
+    updating.erase(build_path_string);
+  return up_to_date;
+}
+
+bool Project::Build::is_updating(const boost::filesystem::path &build_path) {
+  if(updating.count(build_path.string())==0)
+    return false;
+  Info::get().print("Configure in progress");
+  return true;
+}
+
+std::unique_ptr<Project::Build> Project::Build::find(const boost::filesystem::path &search_path_) {
+  auto search_path=search_path_;
   while(true) {
     if(boost::filesystem::exists(search_path/"CMakeLists.txt")) {
-      std::unique_ptr<Project::Build> build(new CMakeBuild(path));
-      if(!build->project_path.empty())
+      std::unique_ptr<Project::Build> build(new CMakeBuild(search_path_));
+      if(!build->project_path.empty()) {
+        monitor(search_path_, build->project_path, "CMakeLists.txt");
         return build;
+      }
       else
         return std::make_unique<Project::Build>();
     }
     
     if(boost::filesystem::exists(search_path/"meson.build")) {
-      std::unique_ptr<Project::Build> build(new MesonBuild(path));
-      if(!build->project_path.empty())
+      std::unique_ptr<Project::Build> build(new MesonBuild(search_path_));
+      if(!build->project_path.empty()) {
+        monitor(search_path_, build->project_path, "meson.build");
         return build;
+      }
     }
     
     if(boost::filesystem::exists(search_path/"Cargo.toml")) {
       std::unique_ptr<Project::Build> build(new CargoBuild());
       build->project_path=search_path;
+      monitor(search_path, search_path, "Cargo.toml");
       return build;
     }
     
     if(boost::filesystem::exists(search_path/"package.json")) {
       std::unique_ptr<Project::Build> build(new NpmBuild());
       build->project_path=search_path;
+      monitor(search_path, search_path, "package.json");
       return build;
     }
     
@@ -40,6 +112,29 @@ std::unique_ptr<Project::Build> Project::Build::create(const boost::filesystem::
   return std::make_unique<Project::Build>();
 }
 
+void Project::Build::monitor(const boost::filesystem::path &search_path, const boost::filesystem::path &project_path, const std::string &file_name) {
+  auto path=search_path;
+  while(true) {
+    auto file_path=path/file_name;
+    if(boost::filesystem::exists(file_path)) {
+      std::unique_lock<std::mutex> lock(cache_mutex);
+      if(monitors.find(file_path.string())==monitors.end()) {
+        auto monitor=Gio::File::create_for_path(file_path.string())->monitor_file(Gio::FileMonitorFlags::FILE_MONITOR_NONE);
+        monitor->signal_changed().connect([](const Glib::RefPtr<Gio::File> &file,
+                                             const Glib::RefPtr<Gio::File>&,
+                                             Gio::FileMonitorEvent monitor_event) {
+          if(monitor_event!=Gio::FileMonitorEvent::FILE_MONITOR_EVENT_CHANGES_DONE_HINT)
+            clear_cache();
+        });
+        monitors.emplace(file_path.string(), monitor);
+      }
+    }
+    if(path==project_path || path==path.root_directory())
+      break;
+    path=path.parent_path();
+  }
+}
+
 boost::filesystem::path Project::Build::get_default_path() {
   if(project_path.empty())
     return boost::filesystem::path();
@@ -102,15 +197,52 @@ Project::CMakeBuild::CMakeBuild(const boost::filesystem::path &path) : Project::
 }
 
 bool Project::CMakeBuild::update_default(bool force) {
-  return cmake.update_default_build(get_default_path(), force);
+  auto default_build_path=get_default_path();
+  if(is_updating(default_build_path))
+    return false;
+  return cmake.update_default_build(default_build_path, force);
 }
 
 bool Project::CMakeBuild::update_debug(bool force) {
-  return cmake.update_debug_build(get_debug_path(), force);
+  auto debug_build_path=get_debug_path();
+  if(is_updating(debug_build_path))
+    return false;
+  return cmake.update_debug_build(debug_build_path, force);
+}
+
+bool Project::CMakeBuild::update_default_async(bool force, const std::function<void(bool success)> &on_done) {
+  auto default_build_path=get_default_path();
+  return update_async(default_build_path, [this, &default_build_path, force](const std::function<void(int exit_status)> &on_exit) {
+    return cmake.update_default_build(default_build_path, force, on_exit);
+  }, on_done);
+}
+
+bool Project::CMakeBuild::update_debug_async(bool force, const std::function<void(bool success)> &on_done) {
+  auto debug_build_path=get_debug_path();
+  return update_async(debug_build_path, [this, &debug_build_path, force](const std::function<void(int exit_status)> &on_exit) {
+    return cmake.update_debug_build(debug_build_path, force, on_exit);
+  }, on_done);
 }
 
 std::string Project::CMakeBuild::get_compile_command() {
-  return Config::get().project.cmake.compile_command;
+  return get_target_compile_command(boost::filesystem::path());
+}
+
+std::string Project::CMakeBuild::get_target_compile_command(const boost::filesystem::path &executable) {
+  auto command=Config::get().project.cmake.compile_command;
+  // Options are only added to the default command, since a custom command might not accept them
+  if(command.compare(0, 13, "cmake --build")!=0 || command.find(" -- ")!=std::string::npos)
+    return command;
+  
+  if(!executable.empty()) {
+    if(auto code_model=CMake::get_code_model(get_default_path())) {
+      auto it=code_model->target_names_by_executable.find(executable.string());
+      if(it!=code_model->target_names_by_executable.end())
+        command+=" --target "+filesystem::escape_argument(it->second);
+    }
+  }
+  // Passed on to the native build tool, since the --parallel option requires CMake 3.12
+  return command+" -- -j"+std::to_string(get_build_jobs());
 }
 
 boost::filesystem::path Project::CMakeBuild::get_executable(const boost::filesystem::path &path) {
@@ -122,15 +254,53 @@ Project::MesonBuild::MesonBuild(const boost::filesystem::path &path) : Project::
 }
 
 bool Project::MesonBuild::update_default(bool force) {
-  return meson.update_default_build(get_default_path(), force);
+  auto default_build_path=get_default_path();
+  if(is_updating(default_build_path))
+    return false;
+  return meson.update_default_build(default_build_path, force);
 }
 
 bool Project::MesonBuild::update_debug(bool force) {
-  return meson.update_debug_build(get_debug_path(), force);
+  auto debug_build_path=get_debug_path();
+  if(is_updating(debug_build_path))
+    return false;
+  return meson.update_debug_build(debug_build_path, force);
+}
+
+bool Project::MesonBuild::update_default_async(bool force, const std::function<void(bool success)> &on_done) {
+  auto default_build_path=get_default_path();
+  return update_async(default_build_path, [this, &default_build_path, force](const std::function<void(int exit_status)> &on_exit) {
+    return meson.update_default_build(default_build_path, force, on_exit);
+  }, on_done);
+}
+
+bool Project::MesonBuild::update_debug_async(bool force, const std::function<void(bool success)> &on_done) {
+  auto debug_build_path=get_debug_path();
+  return update_async(debug_build_path, [this, &debug_build_path, force](const std::function<void(int exit_status)> &on_exit) {
+    return meson.update_debug_build(debug_build_path, force, on_exit);
+  }, on_done);
 }
 
 std::string Project::MesonBuild::get_compile_command() {
-  return Config::get().project.meson.compile_command;
+  return get_target_compile_command(boost::filesystem::path());
+}
+
+std::string Project::MesonBuild::get_target_compile_command(const boost::filesystem::path &executable) {
+  auto command=Config::get().project.meson.compile_command;
+  // Options are only added to the default command, since a custom command might not accept them
+  if(command!="ninja")
+    return command;
+  
+  // Ninja runs parallel jobs by default
+  if(Config::get().project.build_jobs>0)
+    command+=" -j "+std::to_string(Config::get().project.build_jobs);
+  // Ninja targets are the output files relative to the build directory
+  if(!executable.empty()) {
+    auto target=filesystem::get_relative_path(executable, get_default_path());
+    if(!target.empty())
+      command+=' '+filesystem::escape_argument(target.string());
+  }
+  return command;
 }
 
 boost::filesystem::path Project::MesonBuild::get_executable(const boost::filesystem::path &path) {
@@ -1,5 +1,10 @@
 #pragma once
 #include <boost/filesystem.hpp>
+#include <giomm.h>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
 #include "cmake.h"
 #include "meson.h"
 
@@ -14,11 +19,44 @@ namespace Project {
     virtual bool update_default(bool force=false) {return false;}
     virtual boost::filesystem::path get_debug_path();
     virtual bool update_debug(bool force=false) {return false;}
+    /// Like update_default() and update_debug(), but without blocking the main thread. Returns true if the build is up to date.
+    /// Otherwise on_done is called in the main thread when the build has been created or updated, unless
+    /// the build is already being updated. Must be called from the main thread.
+    virtual bool update_default_async(bool force, const std::function<void(bool success)> &on_done) { return update_default(force); }
+    virtual bool update_debug_async(bool force, const std::function<void(bool success)> &on_done) { return update_debug(force); }
     
     virtual std::string get_compile_command() { return std::string(); }
+    /// Returns a compile command that only builds executable and its dependencies, if supported by the build system
+    virtual std::string get_target_compile_command(const boost::filesystem::path &executable) { return get_compile_command(); }
     virtual boost::filesystem::path get_executable(const boost::filesystem::path &path) {return boost::filesystem::path();}
     
+    virtual std::unique_ptr<Build> clone() const { return std::make_unique<Build>(*this); }
+    
+    /// Returns a copy of the cached build for path's directory, or finds and caches it.
+    /// The cache is cleared when one of the build files found is changed. Directories without a build are not cached.
     static std::unique_ptr<Build> create(const boost::filesystem::path &path);
+    /// Called when build files might have been added or removed
+    static void clear_cache();
+    
+  protected:
+    /// Returns Config::get().project.build_jobs, or the number of processor cores if it is 0
+    static unsigned get_build_jobs();
+    /// Calls update, which runs the build system in the background and calls on_exit when done, unless build_path is already being updated
+    static bool update_async(const boost::filesystem::path &build_path, const std::function<bool(const std::function<void(int exit_status)> &on_exit)> &update,
+                             const std::function<void(bool success)> &on_done);
+    /// Returns true, and tells the user, if update_async() is updating build_path. Used to refuse synchronous updates meanwhile.
+    static bool is_updating(const boost::filesystem::path &build_path);
+    
+  private:
+    static std::unique_ptr<Build> find(const boost::filesystem::path &search_path);
+    /// Builds by search directory
+    static std::unordered_map<std::string, std::shared_ptr<const Build>> cache;
+    /// Monitors by build file
+    static std::unordered_map<std::string, Glib::RefPtr<Gio::FileMonitor>> monitors;
+    static std::mutex cache_mutex;
+    /// Build paths being updated by update_async(), only used in the main thread
+    static std::unordered_set<std::string> updating;
+    static void monitor(const boost::filesystem::path &search_path, const boost::filesystem::path &project_path, const std::string &file_name);
   };
   
   class CMakeBuild : public Build {
@@ -28,9 +66,14 @@ namespace Project {
     
     bool update_default(bool force=false) override;
     bool update_debug(bool force=false) override;
+    bool update_default_async(bool force, const std::function<void(bool success)> &on_done) override;
+    bool update_debug_async(bool force, const std::function<void(bool success)> &on_done) override;
     
     std::string get_compile_command() override;
+    std::string get_target_compile_command(const boost::filesystem::path &executable) override;
     boost::filesystem::path get_executable(const boost::filesystem::path &path) override;
+    
+    std::unique_ptr<Build> clone() const override { return std::make_unique<CMakeBuild>(*this); }
   };
   
   class MesonBuild : public Build {
@@ -40,9 +83,14 @@ namespace Project {
     
     bool update_default(bool force=false) override;
     bool update_debug(bool force=false) override;
+    bool update_default_async(bool force, const std::function<void(bool success)> &on_done) override;
+    bool update_debug_async(bool force, const std::function<void(bool success)> &on_done) override;
     
     std::string get_compile_command() override;
+    std::string get_target_compile_command(const boost::filesystem::path &executable) override;
     boost::filesystem::path get_executable(const boost::filesystem::path &path) override;
+    
+    std::unique_ptr<Build> clone() const override { return std::make_unique<MesonBuild>(*this); }
   };
 
   class CargoBuild : public Build {
@@ -54,7 +102,12 @@ namespace Project {
     
     std::string get_compile_command() override { return "cargo build"; }
     boost::filesystem::path get_executable(const boost::filesystem::path &path) override { return get_debug_path()/project_path.filename(); }
+    
+    std::unique_ptr<Build> clone() const override { return std::make_unique<CargoBuild>(*this); }
   };
 
-  class NpmBuild : public Build {};
+  class NpmBuild : public Build {
+  public:
+    std::unique_ptr<Build> clone() const override { return std::make_unique<NpmBuild>(*this); }
+  };
 }
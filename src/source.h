@@ -91,6 +91,9 @@ namespace Source {
     void hide_tooltips() override;
     void hide_dialogs() override;
     
+    void add_diagnostic_tooltip(const Gtk::TextIter &start, const Gtk::TextIter &end, std::string spelling, bool error);
+    void clear_diagnostic_tooltips();
+    
     void set_tab_char_and_size(char tab_char, unsigned tab_size);
     std::pair<char, unsigned> get_tab_char_and_size() {return {tab_char, tab_size};}
     
@@ -106,8 +109,6 @@ namespace Source {
     Glib::RefPtr<Gtk::TextTag> similar_symbol_tag;
     sigc::connection delayed_tag_similar_symbols_connection;
     virtual void show_diagnostic_tooltips(const Gdk::Rectangle &rectangle) { diagnostic_tooltips.show(rectangle); }
-    void add_diagnostic_tooltip(const Gtk::TextIter &start, const Gtk::TextIter &end, std::string spelling, bool error);
-    void clear_diagnostic_tooltips();
     virtual void show_type_tooltips(const Gdk::Rectangle &rectangle) {}
     gdouble on_motion_last_x=0.0;
     gdouble on_motion_last_y=0.0;
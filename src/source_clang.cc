@@ -111,7 +111,20 @@ void Source::ClangViewParse::parse_initialize() {
   auto build=Project::Build::create(file_path);
   if(build->project_path.empty())
     Info::get().print(file_path.filename().string()+": could not find a supported build system");
-  build->update_default();
+  // Parse with default arguments until the build has been created, and reparse the project's views when it is ready
+  auto default_build_path=build->get_default_path();
+  build->update_default_async(false, [project_path=build->project_path, default_build_path](bool success) {
+    if(!success || !boost::filesystem::exists(default_build_path/"compile_commands.json"))
+      return;
+    for(auto &view: views) {
+      if(dynamic_cast<ClangView*>(view) && filesystem::file_in_path(view->file_path, project_path)) {
+        if(view->get_mapped())
+          view->full_reparse();
+        else
+          view->full_reparse_needed=true;
+      }
+    }
+  });
   auto arguments=CompileCommands::get_arguments(build->get_default_path(), file_path);
   clang_tu = std::make_unique<clangmm::TranslationUnit>(clang_index, file_path.string(), arguments, buffer_raw);
   clang_tokens=clang_tu->get_tokens();
@@ -4,6 +4,8 @@
 #include "filesystem.h"
 #include "info.h"
 #include <boost/version.hpp>
+#include <algorithm>
+#include <ctime>
 
 Source::DiffView::Renderer::Renderer() : Gsv::GutterRenderer() {
   set_padding(4, 0);
@@ -34,7 +36,76 @@ void Source::DiffView::Renderer::draw_vfunc(const Cairo::RefPtr<Cairo::Context>
   }
 }
 
-Source::DiffView::DiffView(const boost::filesystem::path &file_path, const Glib::RefPtr<Gsv::Language> &language) : BaseView(file_path, language), renderer(new Renderer()) {
+Source::DiffView::BlameRenderer::BlameRenderer() : Gsv::GutterRenderer() {
+  set_padding(4, 0);
+}
+
+void Source::DiffView::BlameRenderer::draw_vfunc(const Cairo::RefPtr<Cairo::Context> &cr, const Gdk::Rectangle &background_area,
+                                                 const Gdk::Rectangle &cell_area, Gtk::TextIter &start, Gtk::TextIter &end,
+                                                 Gsv::GutterRendererState p6) {
+  auto line=start.get_line();
+  if(line>=static_cast<int>(lines.size()) || lines[line]<0 || lines[line]>=static_cast<int>(texts.size()))
+    return;
+  auto view=get_view();
+  auto color=view->get_style_context()->get_color(Gtk::StateFlags::STATE_FLAG_NORMAL);
+  cr->set_source_rgba(color.get_red(), color.get_green(), color.get_blue(), 0.6);
+  auto layout=view->create_pango_layout(texts[lines[line]]);
+  cr->move_to(cell_area.get_x(), cell_area.get_y());
+  layout->show_in_cairo_context(cr);
+}
+
+Source::DiffView::Worker::Worker() {
+  thread=std::thread([this] {
+    std::unique_lock<std::mutex> lock(mutex);
+    while(true) {
+      condition_variable.wait(lock, [this] {
+        return stop || !jobs.empty();
+      });
+      if(stop)
+        return;
+      auto job=std::move(jobs.front());
+      jobs.pop_front();
+      running_view=job.first;
+      lock.unlock();
+      job.second();
+      lock.lock();
+      running_view=nullptr;
+      condition_variable.notify_all();
+    }
+  });
+}
+
+Source::DiffView::Worker::~Worker() {
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    stop=true;
+  }
+  condition_variable.notify_all();
+  thread.join();
+}
+
+void Source::DiffView::Worker::post(DiffView *view, std::function<void()> &&function) {
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    jobs.emplace_back(view, std::move(function));
+  }
+  condition_variable.notify_all();
+}
+
+void Source::DiffView::Worker::remove(DiffView *view) {
+  std::unique_lock<std::mutex> lock(mutex);
+  for(auto it=jobs.begin();it!=jobs.end();) {
+    if(it->first==view)
+      it=jobs.erase(it);
+    else
+      ++it;
+  }
+  condition_variable.wait(lock, [this, view] {
+    return running_view!=view;
+  });
+}
+
+Source::DiffView::DiffView(const boost::filesystem::path &file_path, const Glib::RefPtr<Gsv::Language> &language) : BaseView(file_path, language), renderer(new Renderer()), blame_renderer(new BlameRenderer()) {
   boost::system::error_code ec;
   canonical_file_path=boost::filesystem::canonical(file_path, ec);
   if(ec)
@@ -49,17 +120,18 @@ Source::DiffView::DiffView(const boost::filesystem::path &file_path, const Glib:
 
 Source::DiffView::~DiffView() {
   dispatcher.disconnect();
+  blame_request=nullptr;
   if(repository) {
     get_gutter(Gtk::TextWindowType::TEXT_WINDOW_LEFT)->remove(renderer.get());
+    if(show_blame)
+      get_gutter(Gtk::TextWindowType::TEXT_WINDOW_LEFT)->remove(blame_renderer.get());
     buffer_insert_connection.disconnect();
     buffer_erase_connection.disconnect();
     monitor_changed_connection.disconnect();
     delayed_buffer_changed_connection.disconnect();
     delayed_monitor_changed_connection.disconnect();
     
-    parse_stop=true;
-    if(parse_thread.joinable())
-      parse_thread.join();
+    Worker::get().remove(this);
   }
 }
 
@@ -70,17 +142,26 @@ void Source::DiffView::configure() {
   }
   else if(repository) {
     get_gutter(Gtk::TextWindowType::TEXT_WINDOW_LEFT)->remove(renderer.get());
+    if(show_blame) {
+      get_gutter(Gtk::TextWindowType::TEXT_WINDOW_LEFT)->remove(blame_renderer.get());
+      show_blame=false;
+      blame=nullptr;
+      blame_request=nullptr;
+    }
     buffer_insert_connection.disconnect();
     buffer_erase_connection.disconnect();
     monitor_changed_connection.disconnect();
     delayed_buffer_changed_connection.disconnect();
     delayed_monitor_changed_connection.disconnect();
     
-    parse_stop=true;
-    if(parse_thread.joinable())
-      parse_thread.join();
+    Worker::get().remove(this);
+    ++diff_generation;
     repository=nullptr;
     diff=nullptr;
+    hunks.clear();
+    changed_start=changed_end=-1;
+    diffing_start=diffing_end=-1;
+    update_tags(0, get_buffer()->get_line_count());
     
     return;
   }
@@ -90,55 +171,47 @@ void Source::DiffView::configure() {
   try {
     repository=Git::get_repository(this->file_path.parent_path());
   }
-  catch(const std::exception &) {
-    return;
+  catch(const std::exception &e) {
+    Terminal::get().async_print(std::string("Error (git): ")+e.what()+'\n', true);
   }
+  if(!repository)
+    return;
   
   get_gutter(Gtk::TextWindowType::TEXT_WINDOW_LEFT)->insert(renderer.get(), -40);
-  parse_state=ParseState::STARTING;
-  parse_stop=false;
-  monitor_changed=false;
+  line_count=get_buffer()->get_line_count();
   
-  buffer_insert_connection=get_buffer()->signal_insert().connect([this](const Gtk::TextBuffer::iterator &iter ,const Glib::ustring &text, int) {
-    //Do not perform git diff if no newline is added and line is already marked as added
-    if(!iter.starts_line() && iter.has_tag(renderer->tag_added)) {
-      bool newline=false;
-      for(auto &c: text.raw()) {
-        if(c=='\n') {
-          newline=true;
+  buffer_insert_connection=get_buffer()->signal_insert().connect([this](const Gtk::TextBuffer::iterator &iter, const Glib::ustring &text, int) {
+    int newlines=0;
+    for(auto &c: text.raw()) {
+      if(c=='\n')
+        ++newlines;
+    }
+    auto line=iter.get_line();
+    if(newlines==0) {
+      // Lines marked as added remain added when their content changes
+      for(auto &hunk: hunks) {
+        if(hunk.new_lines.first>line)
           break;
-        }
+        if(hunk.old_lines.second==0 && line<hunk.new_lines.first+hunk.new_lines.second)
+          return;
       }
-      if(!newline)
-        return;
-    }
-    //Remove tag_removed_above/below if newline is inserted
-    else if(!text.empty() && text[0]=='\n' && iter.has_tag(renderer->tag_removed)) {
-      auto start_iter=get_buffer()->get_iter_at_line(iter.get_line());
-      auto end_iter=get_iter_at_line_end(iter.get_line());
-      end_iter.forward_char();
-      get_buffer()->remove_tag(renderer->tag_removed_above, start_iter, end_iter);
-      get_buffer()->remove_tag(renderer->tag_removed_below, start_iter, end_iter);
     }
-    parse_state=ParseState::IDLE;
-    delayed_buffer_changed_connection.disconnect();
-    delayed_buffer_changed_connection=Glib::signal_timeout().connect([this]() {
-      parse_state=ParseState::STARTING;
-      return false;
-    }, 250);
+    add_changed_lines(line, 1, newlines+1);
   }, false);
   
   buffer_erase_connection=get_buffer()->signal_erase().connect([this](const Gtk::TextBuffer::iterator &start_iter, const Gtk::TextBuffer::iterator &end_iter) {
-    //Do not perform git diff if start_iter and end_iter is at the same line in addition to the line is tagged added
-    if(start_iter.get_line()==end_iter.get_line() && start_iter.has_tag(renderer->tag_added))
-      return;
-    
-    parse_state=ParseState::IDLE;
-    delayed_buffer_changed_connection.disconnect();
-    delayed_buffer_changed_connection=Glib::signal_timeout().connect([this]() {
-      parse_state=ParseState::STARTING;
-      return false;
-    }, 250);
+    auto start_line=start_iter.get_line();
+    auto end_line=end_iter.get_line();
+    if(start_line==end_line) {
+      // Lines marked as added remain added when their content changes
+      for(auto &hunk: hunks) {
+        if(hunk.new_lines.first>start_line)
+          break;
+        if(hunk.old_lines.second==0 && start_line<hunk.new_lines.first+hunk.new_lines.second)
+          return;
+      }
+    }
+    add_changed_lines(start_line, end_line-start_line+1, 1);
   }, false);
   
   monitor_changed_connection=repository->monitor->signal_changed().connect([this](const Glib::RefPtr<Gio::File> &file,
@@ -147,110 +220,13 @@ void Source::DiffView::configure() {
     if(monitor_event!=Gio::FileMonitorEvent::FILE_MONITOR_EVENT_CHANGES_DONE_HINT) {
       delayed_monitor_changed_connection.disconnect();
       delayed_monitor_changed_connection=Glib::signal_timeout().connect([this]() {
-        monitor_changed=true;
-        parse_state=ParseState::STARTING;
-        std::unique_lock<std::mutex> lock(parse_mutex);
-        diff=nullptr;
+        reload();
         return false;
       }, 500);
     }
   });
   
-  parse_thread=std::thread([this]() {
-    std::string status_branch;
-    try {
-      diff=get_diff();
-      status_branch=repository->get_branch();
-    }
-    catch(const std::exception &) {
-      status_branch="";
-    }
-    dispatcher.post([this, status_branch=std::move(status_branch)] {
-      this->status_branch=status_branch;
-      if(update_status_branch)
-        update_status_branch(this);
-    });
-    
-    try {
-      while(true) {
-        while(!parse_stop && parse_state!=ParseState::STARTING && parse_state!=ParseState::PROCESSING)
-          std::this_thread::sleep_for(std::chrono::milliseconds(10));
-        if(parse_stop)
-          break;
-        std::unique_lock<std::mutex> parse_lock(parse_mutex, std::defer_lock);
-        auto expected=ParseState::STARTING;
-        if(parse_state.compare_exchange_strong(expected, ParseState::PREPROCESSING)) {
-          dispatcher.post([this] {
-            auto expected=ParseState::PREPROCESSING;
-            std::unique_lock<std::mutex> parse_lock(parse_mutex, std::defer_lock);
-            if(parse_lock.try_lock()) {
-              if(parse_state.compare_exchange_strong(expected, ParseState::PROCESSING))
-                parse_buffer=get_buffer()->get_text();
-              parse_lock.unlock();
-            }
-            else
-              parse_state.compare_exchange_strong(expected, ParseState::STARTING);
-          });
-        }
-        else if (parse_state==ParseState::PROCESSING && parse_lock.try_lock()) {
-          bool expected_monitor_changed=true;
-          if(monitor_changed.compare_exchange_strong(expected_monitor_changed, false)) {
-            try {
-              diff=get_diff();
-              dispatcher.post([this, status_branch=repository->get_branch()] {
-                this->status_branch=status_branch;
-                if(update_status_branch)
-                  update_status_branch(this);
-              });
-            }
-            catch(const std::exception &) {
-              dispatcher.post([this] {
-                get_buffer()->remove_tag(renderer->tag_added, get_buffer()->begin(), get_buffer()->end());
-                get_buffer()->remove_tag(renderer->tag_modified, get_buffer()->begin(), get_buffer()->end());
-                get_buffer()->remove_tag(renderer->tag_removed, get_buffer()->begin(), get_buffer()->end());
-                get_buffer()->remove_tag(renderer->tag_removed_below, get_buffer()->begin(), get_buffer()->end());
-                get_buffer()->remove_tag(renderer->tag_removed_above, get_buffer()->begin(), get_buffer()->end());
-                renderer->queue_draw();
-                this->status_branch="";
-                if(update_status_branch)
-                  update_status_branch(this);
-              });
-            }
-          }
-          if(diff)
-            lines=diff->get_lines(parse_buffer.raw());
-          else {
-            lines.added.clear();
-            lines.modified.clear();
-            lines.removed.clear();
-          }
-          auto expected=ParseState::PROCESSING;
-          if(parse_state.compare_exchange_strong(expected, ParseState::POSTPROCESSING)) {
-            parse_lock.unlock();
-            dispatcher.post([this] {
-              std::unique_lock<std::mutex> parse_lock(parse_mutex, std::defer_lock);
-              if(parse_lock.try_lock()) {
-                auto expected=ParseState::POSTPROCESSING;
-                if(parse_state.compare_exchange_strong(expected, ParseState::IDLE))
-                  update_lines();
-              }
-            });
-          }
-        }
-      }
-    }
-    catch(const std::exception &e) {
-      dispatcher.post([this, e_what=e.what()] {
-        get_buffer()->remove_tag(renderer->tag_added, get_buffer()->begin(), get_buffer()->end());
-        get_buffer()->remove_tag(renderer->tag_modified, get_buffer()->begin(), get_buffer()->end());
-        get_buffer()->remove_tag(renderer->tag_removed, get_buffer()->begin(), get_buffer()->end());
-        get_buffer()->remove_tag(renderer->tag_removed_below, get_buffer()->begin(), get_buffer()->end());
-        get_buffer()->remove_tag(renderer->tag_removed_above, get_buffer()->begin(), get_buffer()->end());
-        renderer->queue_draw();
-        Terminal::get().print(std::string("Error (git): ")+e_what+'\n', true);
-      });
-    }
-  });
+  reload();
 }
 
 void Source::DiffView::rename(const boost::filesystem::path &path) {
@@ -264,102 +240,406 @@ void Source::DiffView::rename(const boost::filesystem::path &path) {
 }
 
 void Source::DiffView::git_goto_next_diff() {
-  auto iter=get_buffer()->get_insert()->get_iter();
-  auto insert_iter=iter;
-  bool wrapped=false;
-  iter.forward_char();
-  for(;;) {
-    auto toggled_tags=iter.get_toggled_tags();
-    for(auto &toggled_tag: toggled_tags) {
-      if(toggled_tag->property_name()=="git_added" ||
-         toggled_tag->property_name()=="git_modified" ||
-         toggled_tag->property_name()=="git_removed") {
-        get_buffer()->place_cursor(iter);
-        scroll_to(get_buffer()->get_insert(), 0.0, 1.0, 0.5);
-        return;
-      }
-    }
-    if(wrapped && (iter==insert_iter || iter==get_buffer()->end()))
-      break;
-    if(!wrapped && iter==get_buffer()->end()) {
-      iter=get_buffer()->begin();
-      wrapped=true;
-    }
-    else
-      iter.forward_char();
+  // The first line of a hunk, or the line above removed lines
+  auto get_hunk_line=[](const Git::Repository::Diff::Hunk &hunk) {
+    return hunk.new_lines.second==0 ? std::max(hunk.new_lines.first-1, 0) : hunk.new_lines.first;
+  };
+  auto line=get_buffer()->get_insert()->get_iter().get_line();
+  auto it=std::upper_bound(hunks.begin(), hunks.end(), line, [&get_hunk_line](int line, const Git::Repository::Diff::Hunk &hunk) {
+    return line<get_hunk_line(hunk);
+  });
+  if(it==hunks.end())
+    it=hunks.begin();
+  if(it==hunks.end()) {
+    Info::get().print("No changes found in current buffer");
+    return;
   }
-  Info::get().print("No changes found in current buffer");
+  get_buffer()->place_cursor(get_buffer()->get_iter_at_line(get_hunk_line(*it)));
+  scroll_to(get_buffer()->get_insert(), 0.0, 1.0, 0.5);
 }
 
 std::string Source::DiffView::git_get_diff_details() {
   std::string details;
   if(diff) {
-    auto line_nr=get_buffer()->get_insert()->get_iter().get_line();
-    auto iter=get_buffer()->get_iter_at_line(line_nr);
-    if(iter.has_tag(renderer->tag_removed_above))
-      --line_nr;
-    std::unique_lock<std::mutex> lock(parse_mutex);
-    parse_buffer=get_buffer()->get_text();
-    details=diff->get_details(parse_buffer.raw(), line_nr);
+    auto line=get_buffer()->get_insert()->get_iter().get_line();
+    // Hunks containing line, or removed lines below or above line, ordered by their first line
+    auto it=std::lower_bound(hunks.begin(), hunks.end(), line, [](const Git::Repository::Diff::Hunk &hunk, int line) {
+      return hunk.new_lines.first+std::max(hunk.new_lines.second, 1)<=line;
+    });
+    if(it!=hunks.end() && (it->new_lines.second==0 ? it->new_lines.first-1<=line : it->new_lines.first<=line)) {
+      auto &hunk=*it;
+      // Line numbers in hunk headers are 1-based, and refer to the line above empty ranges
+      auto get_header_lines=[](const std::pair<int, int> &lines) {
+        return std::to_string(lines.second==0 ? lines.first : lines.first+1)+','+std::to_string(lines.second);
+      };
+      details="@@ -"+get_header_lines(hunk.old_lines)+" +"+get_header_lines(hunk.new_lines)+" @@\n";
+      auto add_lines=[&details](char origin, const std::string &text) {
+        size_t start=0;
+        while(start<text.size()) {
+          auto end=text.find('\n', start);
+          if(end==std::string::npos)
+            end=text.size()-1;
+          details+=origin+text.substr(start, end-start+1);
+          start=end+1;
+        }
+        if(!details.empty() && details.back()!='\n')
+          details+='\n';
+      };
+      add_lines('-', diff->get_text(hunk.old_lines));
+      if(hunk.new_lines.second>0) {
+        auto start_iter=get_buffer()->get_iter_at_line(hunk.new_lines.first);
+        auto end_line=hunk.new_lines.first+hunk.new_lines.second;
+        auto end_iter=end_line<get_buffer()->get_line_count() ? get_buffer()->get_iter_at_line(end_line) : get_buffer()->end();
+        add_lines('+', get_buffer()->get_text(start_iter, end_iter).raw());
+      }
+    }
   }
   if(details.empty())
     Info::get().print("No changes found at current line");
   return details;
 }
 
+void Source::DiffView::git_toggle_blame() {
+  if(!repository) {
+    Info::get().print("Git blame is only available for files in git repositories when show_git_diff is enabled");
+    return;
+  }
+  if(show_blame) {
+    get_gutter(Gtk::TextWindowType::TEXT_WINDOW_LEFT)->remove(blame_renderer.get());
+    show_blame=false;
+    blame=nullptr;
+    blame_request=nullptr;
+    return;
+  }
+  show_blame=true;
+  blame_renderer->lines.clear();
+  blame_renderer->texts.clear();
+  blame_renderer->set_size(0);
+  get_gutter(Gtk::TextWindowType::TEXT_WINDOW_LEFT)->insert(blame_renderer.get(), -50);
+  load_blame();
+}
+
 ///Return repository diff instance. Throws exception on error
-std::unique_ptr<Git::Repository::Diff> Source::DiffView::get_diff() {
+std::shared_ptr<Git::Repository::Diff> Source::DiffView::get_diff() {
+  return repository->get_diff(get_relative_path());
+}
+
+boost::filesystem::path Source::DiffView::get_relative_path() {
   auto work_path=filesystem::get_normal_path(repository->get_work_path());
-  boost::filesystem::path relative_path;
-  {
-    std::unique_lock<std::mutex> lock(canonical_file_path_mutex);
-    relative_path=filesystem::get_relative_path(canonical_file_path, work_path);
-    if(relative_path.empty())
-      throw std::runtime_error("not a relative path");
+  std::unique_lock<std::mutex> lock(canonical_file_path_mutex);
+  auto relative_path=filesystem::get_relative_path(canonical_file_path, work_path);
+  if(relative_path.empty())
+    throw std::runtime_error("not a relative path");
+  return relative_path;
+}
+
+void Source::DiffView::add_changed_lines(int line, int old_size, int new_size) {
+  auto end=line+old_size;
+  auto delta=new_size-old_size;
+  auto map_start=[line, end, delta](int start) {
+    return start<=line ? start : (start>=end ? start+delta : line);
+  };
+  auto map_end=[line, end, delta, new_size](int start) {
+    return start<=line ? start : (start>=end ? start+delta : line+new_size);
+  };
+  
+  auto start_line=line, end_line=line+new_size;
+  if(changed_start>=0) {
+    start_line=std::min(start_line, map_start(changed_start));
+    end_line=std::max(end_line, map_end(changed_end));
+  }
+  // Diff the lines of the running diff again, since its result will be outdated
+  if(diffing_start>=0) {
+    start_line=std::min(start_line, map_start(diffing_start));
+    end_line=std::max(end_line, map_end(diffing_end));
+    diffing_start=diffing_end=-1;
+    ++diff_generation;
+  }
+  for(auto it=hunks.begin();it!=hunks.end();) {
+    auto hunk_start=it->new_lines.first;
+    auto hunk_end=hunk_start+it->new_lines.second;
+    bool overlaps=it->new_lines.second>0 ? (hunk_start<end && hunk_end>line) : (hunk_start>line && hunk_start<end);
+    if(overlaps) {
+      start_line=std::min(start_line, map_start(hunk_start));
+      end_line=std::max(end_line, map_end(hunk_end));
+      it=hunks.erase(it);
+      continue;
+    }
+    if(hunk_start>=end)
+      it->new_lines.first+=delta;
+    ++it;
   }
-  return std::make_unique<Git::Repository::Diff>(repository->get_diff(relative_path));
+  changed_start=start_line;
+  changed_end=end_line;
+  line_count+=delta;
+  
+  delayed_buffer_changed_connection.disconnect();
+  delayed_buffer_changed_connection=Glib::signal_timeout().connect([this]() {
+    start_diff();
+    return false;
+  }, 250);
 }
 
-void Source::DiffView::update_lines() {
-  get_buffer()->remove_tag(renderer->tag_added, get_buffer()->begin(), get_buffer()->end());
-  get_buffer()->remove_tag(renderer->tag_modified, get_buffer()->begin(), get_buffer()->end());
-  get_buffer()->remove_tag(renderer->tag_removed, get_buffer()->begin(), get_buffer()->end());
-  get_buffer()->remove_tag(renderer->tag_removed_below, get_buffer()->begin(), get_buffer()->end());
-  get_buffer()->remove_tag(renderer->tag_removed_above, get_buffer()->begin(), get_buffer()->end());
+void Source::DiffView::start_diff() {
+  if(changed_start<0)
+    return;
   
-  for(auto &added: lines.added) {
-    auto start_iter=get_buffer()->get_iter_at_line(added.first);
-    auto end_iter=get_iter_at_line_end(added.second-1);
-    end_iter.forward_char();
-    get_buffer()->apply_tag(renderer->tag_added, start_iter, end_iter);
+  if(!diff) {
+    changed_start=changed_end=-1;
+    return;
   }
-  for(auto &modified: lines.modified) {
-    auto start_iter=get_buffer()->get_iter_at_line(modified.first);
-    auto end_iter=get_iter_at_line_end(modified.second-1);
-    end_iter.forward_char();
-    get_buffer()->apply_tag(renderer->tag_modified, start_iter, end_iter);
+  
+  // Diff the whole buffer if the line count is out of sync, for instance due to other line terminators than \n
+  if(line_count!=get_buffer()->get_line_count()) {
+    line_count=get_buffer()->get_line_count();
+    hunks.clear();
+    changed_start=0;
+    changed_end=line_count;
   }
-  for(auto &line_nr: lines.removed) {
-    Gtk::TextIter removed_start, removed_end;
-    if(line_nr>=0) {
-      auto start_iter=get_buffer()->get_iter_at_line(line_nr);
-      removed_start=start_iter;
-      auto end_iter=get_iter_at_line_end(line_nr);
-      end_iter.forward_char();
-      removed_end=end_iter;
-      get_buffer()->apply_tag(renderer->tag_removed_below, start_iter, end_iter);
+  
+  auto start=std::max(changed_start, 0);
+  auto end=std::min(changed_end, line_count);
+  changed_start=changed_end=-1;
+  
+  // Include adjacent hunks, and compute the line differences before and after the diffed lines
+  int delta_before=0, delta_after=0;
+  for(auto it=hunks.begin();it!=hunks.end();) {
+    auto hunk_start=it->new_lines.first;
+    auto hunk_end=hunk_start+it->new_lines.second;
+    if(hunk_start<=end && hunk_end>=start) {
+      start=std::min(start, hunk_start);
+      end=std::max(end, hunk_end);
+      it=hunks.erase(it);
+      continue;
     }
-    if(line_nr+1<get_buffer()->get_line_count()) {
-      auto start_iter=get_buffer()->get_iter_at_line(line_nr+1);
-      if(line_nr<0)
-        removed_start=start_iter;
-      auto end_iter=get_iter_at_line_end(line_nr+1);
-      end_iter.forward_char();
-      removed_end=end_iter;
-      get_buffer()->apply_tag(renderer->tag_removed_above, start_iter, end_iter);
+    if(hunk_end<start)
+      delta_before+=it->new_lines.second-it->old_lines.second;
+    else
+      delta_after+=it->new_lines.second-it->old_lines.second;
+    ++it;
+  }
+  auto &head_line_hashes=diff->get_line_hashes();
+  auto head_start=start-delta_before;
+  auto head_end=end-(line_count-static_cast<int>(head_line_hashes.size())-delta_after);
+  if(head_start<0 || head_end<head_start || head_end>static_cast<int>(head_line_hashes.size())) {
+    hunks.clear();
+    start=0;
+    end=line_count;
+    head_start=0;
+    head_end=head_line_hashes.size();
+  }
+  
+  std::vector<size_t> old_line_hashes(head_line_hashes.begin()+head_start, head_line_hashes.begin()+head_end);
+  std::vector<size_t> new_line_hashes;
+  new_line_hashes.reserve(end-start);
+  for(int line=start;line<end;++line) {
+    auto start_iter=get_buffer()->get_iter_at_line(line);
+    auto end_iter=get_iter_at_line_end(line);
+    auto text=get_buffer()->get_text(start_iter, end_iter);
+    new_line_hashes.emplace_back(Git::Repository::Diff::get_line_hash(text.raw().data(), text.raw().size()));
+  }
+  
+  diffing_start=start;
+  diffing_end=end;
+  auto generation=++diff_generation;
+  Worker::get().post(this, [this, generation, start, end, head_start, old_line_hashes=std::move(old_line_hashes), new_line_hashes=std::move(new_line_hashes)] {
+    auto result=std::make_shared<std::vector<Git::Repository::Diff::Hunk>>(Git::Repository::Diff::get_hunks(old_line_hashes, new_line_hashes));
+    dispatcher.post([this, generation, start, end, head_start, result] {
+      if(generation!=diff_generation)
+        return;
+      diffing_start=diffing_end=-1;
+      for(auto &hunk: *result) {
+        hunk.old_lines.first+=head_start;
+        hunk.new_lines.first+=start;
+      }
+      auto it=std::lower_bound(hunks.begin(), hunks.end(), start, [](const Git::Repository::Diff::Hunk &hunk, int line) {
+        return hunk.new_lines.first<line;
+      });
+      hunks.insert(it, result->begin(), result->end());
+      update_tags(start-1, end+1);
+      if(show_blame)
+        update_blame_lines();
+    });
+  });
+}
+
+void Source::DiffView::reload() {
+  Worker::get().post(this, [this] {
+    std::shared_ptr<Git::Repository::Diff> diff;
+    std::string status_branch;
+    try {
+      diff=get_diff();
+      status_branch=repository->get_branch();
+    }
+    catch(const std::exception &e) {
+      diff=nullptr;
+      Terminal::get().async_print(std::string("Error (git): ")+e.what()+'\n', true);
+    }
+    dispatcher.post([this, diff=std::move(diff), status_branch=std::move(status_branch)] {
+      if(!repository)
+        return;
+      
+      this->status_branch=status_branch;
+      if(update_status_branch)
+        update_status_branch(this);
+      
+      // The hunks are still valid if the file in HEAD has not changed
+      if(diff && diff==this->diff)
+        return;
+      this->diff=diff;
+      if(show_blame)
+        load_blame();
+      ++diff_generation;
+      hunks.clear();
+      diffing_start=diffing_end=-1;
+      line_count=get_buffer()->get_line_count();
+      if(diff) {
+        changed_start=0;
+        changed_end=line_count;
+        start_diff();
+      }
+      else {
+        changed_start=changed_end=-1;
+        update_tags(0, line_count);
+      }
+    });
+  });
+}
+
+void Source::DiffView::update_tags(int start, int end) {
+  auto buffer_line_count=get_buffer()->get_line_count();
+  start=std::max(start, 0);
+  end=std::min(end, buffer_line_count);
+  if(start>=end)
+    return;
+  
+  auto get_iter=[this, buffer_line_count](int line) {
+    return line<buffer_line_count ? get_buffer()->get_iter_at_line(line) : get_buffer()->end();
+  };
+  auto apply_tag=[this, start, end, &get_iter](const Glib::RefPtr<Gtk::TextTag> &tag, int tag_start, int tag_end) {
+    tag_start=std::max(tag_start, start);
+    tag_end=std::min(tag_end, end);
+    if(tag_start<tag_end)
+      get_buffer()->apply_tag(tag, get_iter(tag_start), get_iter(tag_end));
+  };
+  
+  auto start_iter=get_iter(start);
+  auto end_iter=get_iter(end);
+  get_buffer()->remove_tag(renderer->tag_added, start_iter, end_iter);
+  get_buffer()->remove_tag(renderer->tag_modified, start_iter, end_iter);
+  get_buffer()->remove_tag(renderer->tag_removed, start_iter, end_iter);
+  get_buffer()->remove_tag(renderer->tag_removed_below, start_iter, end_iter);
+  get_buffer()->remove_tag(renderer->tag_removed_above, start_iter, end_iter);
+  
+  for(auto &hunk: hunks) {
+    auto hunk_start=hunk.new_lines.first;
+    auto hunk_end=hunk_start+hunk.new_lines.second;
+    if(hunk_start>end)
+      break;
+    if(hunk_end<start-1)
+      continue;
+    if(hunk.old_lines.second==0)
+      apply_tag(renderer->tag_added, hunk_start, hunk_end);
+    else if(hunk.new_lines.second==0) {
+      apply_tag(renderer->tag_removed_below, hunk_start-1, hunk_start);
+      apply_tag(renderer->tag_removed_above, hunk_start, hunk_start+1);
+      apply_tag(renderer->tag_removed, hunk_start-1, hunk_start+1);
     }
-    get_buffer()->apply_tag(renderer->tag_removed, removed_start, removed_end);
+    else
+      apply_tag(renderer->tag_modified, hunk_start, hunk_end);
   }
   
   renderer->queue_draw();
 }
+
+void Source::DiffView::load_blame() {
+  boost::filesystem::path relative_path;
+  try {
+    relative_path=get_relative_path();
+  }
+  catch(const std::exception &e) {
+    Info::get().print(std::string("Could not get git blame: ")+e.what());
+    get_gutter(Gtk::TextWindowType::TEXT_WINDOW_LEFT)->remove(blame_renderer.get());
+    show_blame=false;
+    return;
+  }
+  
+  // The blame is made in its own thread, since it can take a while and should not delay the diffs.
+  // The view does not wait for the thread, and the result is discarded if blame_request has been reset.
+  static Dispatcher blame_dispatcher;
+  blame_request=std::make_shared<bool>(true);
+  std::thread blame_thread([this, request=std::weak_ptr<bool>(blame_request), repository=repository, relative_path=std::move(relative_path), cache_directory=Config::get().home_juci_path/"blame"] {
+    std::shared_ptr<const Git::Repository::Blame> blame;
+    std::string error;
+    try {
+      blame=repository->get_blame(relative_path, cache_directory);
+    }
+    catch(const std::exception &e) {
+      error=e.what();
+    }
+    blame_dispatcher.post([this, request=std::move(request), blame=std::move(blame), error=std::move(error)] {
+      if(request.expired() || !show_blame)
+        return;
+      if(!blame) {
+        Info::get().print("Could not get git blame: "+error);
+        get_gutter(Gtk::TextWindowType::TEXT_WINDOW_LEFT)->remove(blame_renderer.get());
+        show_blame=false;
+        return;
+      }
+      this->blame=blame;
+      
+      blame_renderer->texts.clear();
+      blame_renderer->texts.reserve(blame->hunks.size()+1);
+      size_t longest_text=0;
+      for(auto &hunk: blame->hunks) {
+        char date[11];
+        auto time=hunk.time;
+        std::strftime(date, sizeof(date), "%Y-%m-%d", std::localtime(&time));
+        Glib::ustring author(hunk.author);
+        if(author.size()>20)
+          author=author.substr(0, 19)+"…";
+        blame_renderer->texts.emplace_back(hunk.commit_id.substr(0, 7)+' '+date+' '+author.raw());
+        if(blame_renderer->texts.back().size()>blame_renderer->texts[longest_text].size())
+          longest_text=blame_renderer->texts.size()-1;
+      }
+      blame_renderer->texts.emplace_back("Not committed");
+      int width, height;
+      create_pango_layout(blame_renderer->texts[longest_text])->get_pixel_size(width, height);
+      blame_renderer->set_size(width);
+      
+      update_blame_lines();
+    });
+  });
+  blame_thread.detach();
+}
+
+void Source::DiffView::update_blame_lines() {
+  if(!blame)
+    return;
+  auto buffer_line_count=get_buffer()->get_line_count();
+  auto not_committed=static_cast<int>(blame->hunks.size());
+  std::vector<int> line_texts(buffer_line_count, -1);
+  int line=0, head_line=0;
+  auto add_unchanged_lines=[this, &line_texts, &line, &head_line, buffer_line_count](int end) {
+    for(;line<end && line<buffer_line_count;++line, ++head_line) {
+      auto index=blame->get_hunk_index(head_line);
+      if(index>=0)
+        line_texts[line]=index;
+    }
+  };
+  for(auto &hunk: hunks) {
+    add_unchanged_lines(hunk.new_lines.first);
+    for(;line<hunk.new_lines.first+hunk.new_lines.second && line<buffer_line_count;++line)
+      line_texts[line]=not_committed;
+    head_line=hunk.old_lines.first+hunk.old_lines.second;
+  }
+  add_unchanged_lines(buffer_line_count);
+  
+  // Only show the text at the first line of each blame hunk
+  blame_renderer->lines.assign(buffer_line_count, -1);
+  for(int line=0;line<buffer_line_count;++line) {
+    if(line==0 || line_texts[line]!=line_texts[line-1])
+      blame_renderer->lines[line]=line_texts[line];
+  }
+  blame_renderer->queue_draw();
+}
@@ -2,17 +2,15 @@
 #include "source_base.h"
 #include <boost/filesystem.hpp>
 #include "dispatcher.h"
-#include <set>
-#include <map>
+#include <condition_variable>
+#include <functional>
+#include <list>
 #include <thread>
-#include <atomic>
 #include <mutex>
 #include "git.h"
 
 namespace Source {
   class DiffView : virtual public Source::BaseView {
-    enum class ParseState {IDLE, STARTING, PREPROCESSING, PROCESSING, POSTPROCESSING};
-    
     class Renderer : public Gsv::GutterRenderer {
     public:
       Renderer();
@@ -28,6 +26,41 @@ namespace Source {
                       const Gdk::Rectangle &cell_area, Gtk::TextIter &start, Gtk::TextIter &end,
                       Gsv::GutterRendererState p6) override;
     };
+    
+    class BlameRenderer : public Gsv::GutterRenderer {
+    public:
+      BlameRenderer();
+      
+      /// Index of the text shown at each line, or -1 for no text
+      std::vector<int> lines;
+      std::vector<std::string> texts;
+      
+    protected:
+      void draw_vfunc(const Cairo::RefPtr<Cairo::Context> &cr, const Gdk::Rectangle &background_area,
+                      const Gdk::Rectangle &cell_area, Gtk::TextIter &start, Gtk::TextIter &end,
+                      Gsv::GutterRendererState p6) override;
+    };
+    
+    /// Single thread shared by all diff views, running the git diffs in the order they were requested
+    class Worker {
+      Worker();
+      std::thread thread;
+      std::mutex mutex;
+      std::condition_variable condition_variable;
+      std::list<std::pair<DiffView *, std::function<void()>>> jobs;
+      DiffView *running_view = nullptr;
+      bool stop = false;
+    public:
+      static Worker &get() {
+        static Worker singleton;
+        return singleton;
+      }
+      ~Worker();
+      
+      void post(DiffView *view, std::function<void()> &&function);
+      /// Removes the queued jobs of view, and waits for its running job to finish
+      void remove(DiffView *view);
+    };
   public:
     DiffView(const boost::filesystem::path &file_path, const Glib::RefPtr<Gsv::Language> &language);
     ~DiffView() override;
@@ -38,6 +71,8 @@ namespace Source {
     
     void git_goto_next_diff();
     std::string git_get_diff_details();
+    /// Shows or hides the git blame of the buffer in the gutter
+    void git_toggle_blame();
     
     /// Use canonical path to follow symbolic links
     boost::filesystem::path canonical_file_path;
@@ -48,22 +83,46 @@ namespace Source {
     Dispatcher dispatcher;
     
     std::shared_ptr<Git::Repository> repository;
-    std::unique_ptr<Git::Repository::Diff> diff;
-    std::unique_ptr<Git::Repository::Diff> get_diff();
+    std::shared_ptr<Git::Repository::Diff> diff;
+    std::shared_ptr<Git::Repository::Diff> get_diff();
+    /// Returns the file path relative to the work path. Throws exception on error.
+    boost::filesystem::path get_relative_path();
     
-    std::thread parse_thread;
-    std::atomic<ParseState> parse_state;
-    std::mutex parse_mutex;
-    std::atomic<bool> parse_stop;
-    Glib::ustring parse_buffer;
     sigc::connection buffer_insert_connection;
     sigc::connection buffer_erase_connection;
     sigc::connection monitor_changed_connection;
     sigc::connection delayed_buffer_changed_connection;
     sigc::connection delayed_monitor_changed_connection;
-    std::atomic<bool> monitor_changed;
     
-    Git::Repository::Diff::Lines lines;
-    void update_lines();
+    /// Differences between HEAD and the buffer outside of the changed lines, ordered by buffer line.
+    /// Line numbers are 0-based, and lines between the hunks are equal in HEAD and in the buffer.
+    std::vector<Git::Repository::Diff::Hunk> hunks;
+    /// Buffer lines that have changed since they were last diffed, -1 if none
+    int changed_start = -1, changed_end = -1;
+    /// Buffer lines of the diff running in Worker, -1 if none
+    int diffing_start = -1, diffing_end = -1;
+    /// Incremented to discard the results of running diffs
+    size_t diff_generation = 0;
+    /// Buffer line count according to the insert and erase handlers
+    int line_count = 0;
+    
+    /// Called before lines [line, line+old_size) are replaced with new_size lines
+    void add_changed_lines(int line, int old_size, int new_size);
+    /// Diffs the changed lines in Worker
+    void start_diff();
+    /// Gets the file in HEAD in Worker, and diffs the whole buffer if it has changed
+    void reload();
+    /// Updates the tags of lines [start, end) from hunks
+    void update_tags(int start, int end);
+    
+    std::unique_ptr<BlameRenderer> blame_renderer;
+    bool show_blame = false;
+    std::shared_ptr<const Git::Repository::Blame> blame;
+    /// Set for the latest blame request, and reset to discard its result
+    std::shared_ptr<bool> blame_request;
+    /// Gets the blame in a separate thread
+    void load_blame();
+    /// Maps the blame of the file in HEAD to the buffer lines using hunks
+    void update_blame_lines();
   };
 }
@@ -8,13 +8,117 @@
 #include "debug_lldb.h"
 #endif
 #include "menu.h"
+#include <algorithm>
 #include <regex>
 #include <future>
 #include <limits>
 
 const bool output_messages_and_errors=false;
 
-LanguageProtocol::Client::Client(std::string root_uri_, std::string language_id_) : root_uri(std::move(root_uri_)), language_id(std::move(language_id_)) {
+const std::chrono::minutes language_server_idle_timeout(5);
+
+std::string LanguageProtocol::get_language_id(const boost::filesystem::path &file_path, const Glib::RefPtr<Gsv::Language> &language) {
+  if(!language)
+    return std::string();
+  auto language_id=language->get_id();
+  if(language_id=="chdr" || language_id=="cpphdr" || language_id=="c" || language_id=="cpp" || language_id=="objc")
+    return std::string();
+  if(language_id=="js")
+    return file_path.extension()==".ts"?"typescript":"javascript";
+  return language_id;
+}
+
+std::unordered_map<std::string, std::shared_ptr<LanguageProtocol::Client>> LanguageProtocol::Client::cache;
+std::mutex LanguageProtocol::Client::cache_mutex;
+std::vector<std::unique_ptr<LanguageProtocol::Client>> LanguageProtocol::Client::shut_down_clients;
+std::mutex LanguageProtocol::Client::shut_down_clients_mutex;
+
+LanguageProtocol::Client::Client(std::string root_uri_, std::string language_id_) : root_uri(std::move(root_uri_)), language_id(std::move(language_id_)), last_used(std::chrono::steady_clock::now()) {
+  start_process();
+  
+  timeout_thread=std::thread([this] {
+    std::unique_lock<std::mutex> lock(read_write_mutex);
+    while(!timeout_thread_stop) {
+      auto now=std::chrono::steady_clock::now();
+      if(now>=kill_deadline) {
+        process->kill(true);
+        kill_deadline=std::chrono::steady_clock::time_point::max();
+        continue;
+      }
+      auto it=timeouts.begin();
+      if(it==timeouts.end() || now<it->second) {
+        auto deadline=std::min(it!=timeouts.end()?it->second:std::chrono::steady_clock::time_point::max(), kill_deadline);
+        if(deadline==std::chrono::steady_clock::time_point::max())
+          timeouts_condition_variable.wait(lock);
+        else
+          timeouts_condition_variable.wait_until(lock, deadline);
+        continue;
+      }
+      auto message_id=it->first;
+      if(auto function=extract_handler(message_id)) {
+        add_cancelled_message_id(message_id);
+        lock.unlock();
+        write_notification("$/cancelRequest", "\"id\":"+std::to_string(message_id));
+        function(boost::property_tree::ptree(), false);
+        lock.lock();
+      }
+    }
+  });
+  
+  exit_thread=std::thread([this] {
+    size_t early_exits=0;
+    while(true) {
+      auto exit_status=process->get_exit_status();
+      
+      std::vector<std::function<void(const boost::property_tree::ptree &, bool)>> functions;
+      {
+        std::unique_lock<std::mutex> lock(read_write_mutex);
+        if(!shutting_down) {
+          // The pending requests will never be answered
+          for(auto &handler: handlers)
+            functions.emplace_back(std::move(handler.second.second));
+          handlers.clear();
+          timeouts.clear();
+          cancelled_message_ids.clear();
+          latest_requests.clear();
+        }
+      }
+      for(auto &function: functions)
+        function(boost::property_tree::ptree(), true);
+      
+      {
+        std::unique_lock<std::mutex> initialize_lock(initialize_mutex);
+        std::unique_lock<std::mutex> lock(read_write_mutex);
+        if(std::chrono::steady_clock::now()-process_start_time<std::chrono::seconds(30))
+          ++early_exits;
+        else
+          early_exits=0;
+        exited=shutting_down || early_exits>=3;
+        if(shutting_down)
+          return;
+        if(exited) {
+          Terminal::get().async_print("Error: "+language_id+"-language-server exited with status "+std::to_string(exit_status)+" shortly after being started several times, and will not be restarted.\n", true);
+          return;
+        }
+        Terminal::get().async_print("Warning: "+language_id+"-language-server exited unexpectedly with status "+std::to_string(exit_status)+". Restarting language server.\n", true);
+        server_message_stream=std::stringstream();
+        header_read=false;
+        server_message_size=static_cast<size_t>(-1);
+        start_process();
+        initialized=false;
+      }
+      
+      initialize(nullptr);
+      
+      std::unique_lock<std::mutex> lock(views_mutex);
+      for(auto view: views)
+        view->reopen();
+    }
+  });
+}
+
+void LanguageProtocol::Client::start_process() {
+  process_start_time=std::chrono::steady_clock::now();
   process = std::make_unique<TinyProcessLib::Process>(language_id+"-language-server", root_uri,
                                                       [this](const char *bytes, size_t n) {
     server_message_stream.write(bytes, n);
@@ -34,46 +138,148 @@ std::shared_ptr<LanguageProtocol::Client> LanguageProtocol::Client::get(const bo
   
   auto cache_id=root_uri+'|'+language_id;
   
-  static std::unordered_map<std::string, std::weak_ptr<Client>> cache;
-  static std::mutex mutex;
-  std::lock_guard<std::mutex> lock(mutex);
+  static auto shutdown_idle_connection=Glib::signal_timeout().connect([] {
+    shutdown_idle();
+    return true;
+  }, 30000);
+  
+  std::lock_guard<std::mutex> lock(cache_mutex);
   auto it=cache.find(cache_id);
-  if(it==cache.end())
-    it=cache.emplace(cache_id, std::weak_ptr<Client>()).first;
-  auto instance=it->second.lock();
-  if(!instance)
-    it->second=instance=std::shared_ptr<Client>(new Client(root_uri, language_id), [](Client *client_ptr) {
-      std::thread delete_thread([client_ptr] {
-        delete client_ptr;
-      });
-      delete_thread.detach();
+  if(it!=cache.end()) {
+    // A language server that will not be restarted is replaced, and the old client is deleted when its last view is closed
+    std::unique_lock<std::mutex> lock(it->second->read_write_mutex);
+    if(it->second->exited) {
+      lock.unlock();
+      cache.erase(it);
+      it=cache.end();
+    }
+  }
+  if(it==cache.end()) {
+    it=cache.emplace(cache_id, std::shared_ptr<Client>(new Client(root_uri, language_id), [](Client *client_ptr) {
+      client_ptr->shutdown();
+    })).first;
+  }
+  else {
+    std::unique_lock<std::mutex> lock(it->second->views_mutex);
+    it->second->last_used=std::chrono::steady_clock::now();
+  }
+  return it->second;
+}
+
+void LanguageProtocol::Client::prespawn(const boost::filesystem::path &directory) {
+  std::map<std::string, boost::filesystem::path> language_id_files;
+  for(auto &search_path: {directory, directory/"src"}) {
+    boost::system::error_code ec;
+    boost::filesystem::directory_iterator end_it;
+    for(boost::filesystem::directory_iterator it(search_path, ec);!ec && it!=end_it;it.increment(ec)) {
+      auto file_path=it->path();
+      if(!boost::filesystem::is_regular_file(file_path, ec))
+        continue;
+      auto language_id=get_language_id(file_path, Source::guess_language(file_path));
+      if(!language_id.empty())
+        language_id_files.emplace(language_id, file_path);
+    }
+  }
+  
+  for(auto &language_id_file: language_id_files) {
+    if(filesystem::find_executable(language_id_file.first+"-language-server").empty())
+      continue;
+    auto client=get(language_id_file.second, language_id_file.first);
+    std::thread initialize_thread([client] {
+      client->initialize(nullptr);
     });
-  return instance;
+    initialize_thread.detach();
+  }
 }
 
-LanguageProtocol::Client::~Client() {
-  std::promise<void> result_processed;
-  write_request(nullptr, "shutdown", "", [this, &result_processed](const boost::property_tree::ptree &result, bool error) {
+void LanguageProtocol::Client::shutdown_idle(bool all) {
+  {
+    std::vector<std::shared_ptr<Client>> idle_clients; // Released after cache_mutex is unlocked
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto now=std::chrono::steady_clock::now();
+    for(auto it=cache.begin();it!=cache.end();) {
+      if(it->second.use_count()==1) {
+        std::unique_lock<std::mutex> lock(it->second->views_mutex);
+        auto idle=all || now-it->second->last_used>language_server_idle_timeout;
+        lock.unlock();
+        if(idle) {
+          idle_clients.emplace_back(std::move(it->second));
+          it=cache.erase(it);
+          continue;
+        }
+      }
+      ++it;
+    }
+  }
+  
+  delete_shut_down_clients(all);
+}
+
+void LanguageProtocol::Client::shutdown() {
+  std::unique_lock<std::mutex> lock(read_write_mutex);
+  if(exited) { // The language server has crashed and will not be restarted
+    lock.unlock();
+    delete this;
+    return;
+  }
+  shutting_down=true;
+  kill_deadline=std::chrono::steady_clock::now()+std::chrono::seconds(10);
+  lock.unlock();
+  timeouts_condition_variable.notify_one();
+  
+  write_request(nullptr, "shutdown", "", [this](const boost::property_tree::ptree &result, bool error) {
     if(!error)
       this->write_notification("exit", "");
-    result_processed.set_value();
   });
-  result_processed.get_future().get();
   
-  std::unique_lock<std::mutex> lock(timeout_threads_mutex);
-  for(auto &thread: timeout_threads)
-    thread.join();
+  // Added after the shutdown request is written, since the client can be deleted as soon as it is in shut_down_clients
+  std::lock_guard<std::mutex> shut_down_clients_lock(shut_down_clients_mutex);
+  shut_down_clients.emplace_back(this);
+}
+
+void LanguageProtocol::Client::delete_shut_down_clients(bool wait) {
+  std::vector<std::unique_ptr<Client>> clients; // Deleted after shut_down_clients_mutex is unlocked
+  {
+    std::lock_guard<std::mutex> shut_down_clients_lock(shut_down_clients_mutex);
+    for(auto it=shut_down_clients.begin();it!=shut_down_clients.end();) {
+      std::unique_lock<std::mutex> lock((*it)->read_write_mutex);
+      if(wait || (*it)->exited) {
+        lock.unlock();
+        clients.emplace_back(std::move(*it));
+        it=shut_down_clients.erase(it);
+      }
+      else
+        ++it;
+    }
+  }
   
-  int exit_status=-1;
-  for(size_t c=0;c<20;++c) {
-    std::this_thread::sleep_for(std::chrono::milliseconds(500));
-    if(process->try_get_exit_status(exit_status))
-      break;
+  if(wait) {
+    auto kill_deadline=std::chrono::steady_clock::now()+std::chrono::seconds(2);
+    for(auto &client: clients) {
+      {
+        std::unique_lock<std::mutex> lock(client->read_write_mutex);
+        client->kill_deadline=std::min(client->kill_deadline, kill_deadline);
+      }
+      client->timeouts_condition_variable.notify_one();
+    }
+    // exit_thread returns when the language server has exited, at the latest when it is killed by timeout_thread
+    for(auto &client: clients) {
+      if(client->exit_thread.joinable())
+        client->exit_thread.join();
+    }
   }
-  if(output_messages_and_errors)
-    std::cout << "Language server exit status: " << exit_status << std::endl;
-  if(exit_status==-1)
-    process->kill();
+}
+
+LanguageProtocol::Client::~Client() {
+  {
+    std::unique_lock<std::mutex> lock(read_write_mutex);
+    timeout_thread_stop=true;
+  }
+  timeouts_condition_variable.notify_one();
+  timeout_thread.join();
+  
+  if(exit_thread.joinable())
+    exit_thread.join();
 }
 
 LanguageProtocol::Capabilities LanguageProtocol::Client::initialize(Source::LanguageProtocolView *view) {
@@ -88,7 +294,7 @@ LanguageProtocol::Capabilities LanguageProtocol::Client::initialize(Source::Lang
     return capabilities;
   
   std::promise<void> result_processed;
-  write_request(nullptr, "initialize", "\"processId\":"+std::to_string(process->get_id())+R"(,"rootUri":"file://)"+root_uri+R"(","capabilities":{"workspace":{"didChangeConfiguration":{"dynamicRegistration":true},"didChangeWatchedFiles":{"dynamicRegistration":true},"symbol":{"dynamicRegistration":true},"executeCommand":{"dynamicRegistration":true}},"textDocument":{"synchronization":{"dynamicRegistration":true,"willSave":true,"willSaveWaitUntil":true,"didSave":true},"completion":{"dynamicRegistration":true,"completionItem":{"snippetSupport":true}},"hover":{"dynamicRegistration":true},"signatureHelp":{"dynamicRegistration":true},"definition":{"dynamicRegistration":true},"references":{"dynamicRegistration":true},"documentHighlight":{"dynamicRegistration":true},"documentSymbol":{"dynamicRegistration":true},"codeAction":{"dynamicRegistration":true},"codeLens":{"dynamicRegistration":true},"formatting":{"dynamicRegistration":true},"rangeFormatting":{"dynamicRegistration":true},"onTypeFormatting":{"dynamicRegistration":true},"rename":{"dynamicRegistration":true},"documentLink":{"dynamicRegistration":true}}},"initializationOptions":{"omitInitBuild":true},"trace":"off")", [this, &result_processed](const boost::property_tree::ptree &result, bool error) {
+  write_request(nullptr, "initialize", "\"processId\":"+std::to_string(process->get_id())+R"(,"rootUri":"file://)"+root_uri+R"(","capabilities":{"workspace":{"didChangeConfiguration":{"dynamicRegistration":true},"didChangeWatchedFiles":{"dynamicRegistration":true},"symbol":{"dynamicRegistration":true},"executeCommand":{"dynamicRegistration":true}},"textDocument":{"synchronization":{"dynamicRegistration":true,"willSave":true,"willSaveWaitUntil":true,"didSave":true},"completion":{"dynamicRegistration":true,"completionItem":{"snippetSupport":true}},"hover":{"dynamicRegistration":true},"signatureHelp":{"dynamicRegistration":true},"definition":{"dynamicRegistration":true},"references":{"dynamicRegistration":true},"documentHighlight":{"dynamicRegistration":true},"documentSymbol":{"dynamicRegistration":true},"codeAction":{"dynamicRegistration":true},"codeLens":{"dynamicRegistration":true},"formatting":{"dynamicRegistration":true},"rangeFormatting":{"dynamicRegistration":true},"onTypeFormatting":{"dynamicRegistration":true},"rename":{"dynamicRegistration":true},"documentLink":{"dynamicRegistration":true},"semanticTokens":{"dynamicRegistration":false,"requests":{"full":{"delta":true}},"tokenTypes":["namespace","type","class","enum","interface","struct","typeParameter","parameter","variable","property","enumMember","function","method","macro","keyword","modifier","comment","string","number","regexp"],"tokenModifiers":[],"formats":["relative"]}}},"initializationOptions":{"omitInitBuild":true},"trace":"off")", [this, &result_processed](const boost::property_tree::ptree &result, bool error) {
     if(!error) {
       auto capabilities_pt=result.find("capabilities");
       if(capabilities_pt!=result.not_found()) {
@@ -102,9 +308,26 @@ LanguageProtocol::Capabilities LanguageProtocol::Client::initialize(Source::Lang
         capabilities.document_formatting=capabilities_pt->second.get<bool>("documentFormattingProvider", false);
         capabilities.document_range_formatting=capabilities_pt->second.get<bool>("documentRangeFormattingProvider", false);
         capabilities.rename=capabilities_pt->second.get<bool>("renameProvider", false);
+        capabilities.semantic_tokens=false;
+        capabilities.semantic_tokens_delta=false;
+        capabilities.semantic_token_types.clear();
+        auto semantic_tokens_provider_it=capabilities_pt->second.find("semanticTokensProvider");
+        if(semantic_tokens_provider_it!=capabilities_pt->second.not_found()) {
+          auto full_it=semantic_tokens_provider_it->second.find("full");
+          if(full_it!=semantic_tokens_provider_it->second.not_found()) {
+            capabilities.semantic_tokens=full_it->second.get_value<bool>(false) || !full_it->second.empty();
+            capabilities.semantic_tokens_delta=full_it->second.get<bool>("delta", false);
+          }
+          for(auto &token_type: semantic_tokens_provider_it->second.get_child("legend.tokenTypes", boost::property_tree::ptree()))
+            capabilities.semantic_token_types.emplace_back(token_type.second.get_value<std::string>(""));
+        }
       }
       
       write_notification("initialized", "");
+      {
+        std::unique_lock<std::mutex> lock(read_write_mutex);
+        initialized=true;
+      }
       if(language_id=="rust")
         write_notification("workspace/didChangeConfiguration", R"("settings":{"rust":{"sysroot":null,"target":null,"rustflags":null,"clear_env_rust_log":true,"build_lib":null,"build_bin":null,"cfg_test":false,"unstable_features":false,"wait_to_build":500,"show_warnings":true,"goto_def_racer_fallback":false,"use_crate_blacklist":true,"build_on_save":false,"workspace_mode":true,"analyze_package":null,"features":[],"all_features":false,"no_default_features":false}})");
     }
@@ -112,6 +335,7 @@ LanguageProtocol::Capabilities LanguageProtocol::Client::initialize(Source::Lang
   });
   result_processed.get_future().get();
   
+  std::unique_lock<std::mutex> write_lock(read_write_mutex);
   initialized=true;
   return capabilities;
 }
@@ -122,11 +346,15 @@ void LanguageProtocol::Client::close(Source::LanguageProtocolView *view) {
     auto it=views.find(view);
     if(it!=views.end())
       views.erase(it);
+    last_used=std::chrono::steady_clock::now();
   }
   std::unique_lock<std::mutex> lock(read_write_mutex);
+  latest_requests.erase(view);
   for(auto it=handlers.begin();it!=handlers.end();) {
-    if(it->second.first==view)
+    if(it->second.first==view) {
+      timeouts.erase(it->first);
       it=handlers.erase(it);
+    }
     else
       it++;
   }
@@ -169,53 +397,63 @@ void LanguageProtocol::Client::parse_server_message() {
       }
       
       server_message_stream.seekg(server_message_content_pos, std::ios::beg);
-      boost::property_tree::ptree pt;
-      boost::property_tree::read_json(server_message_stream, pt);
-      
-      if(output_messages_and_errors) {
-        std::cout << "language server: ";
-        boost::property_tree::write_json(std::cout, pt);
-      }
-      
-      auto message_id=pt.get<size_t>("id", 0);
-      auto result_it=pt.find("result");
-      auto error_it=pt.find("error");
+      bool cancelled=false;
       {
         std::unique_lock<std::mutex> lock(read_write_mutex);
-        if(result_it!=pt.not_found()) {
-          if(message_id) {
-            auto id_it=handlers.find(message_id);
-            if(id_it!=handlers.end()) {
-              auto function=std::move(id_it->second.second);
-              handlers.erase(id_it->first);
-              lock.unlock();
-              function(result_it->second, false);
-              lock.lock();
+        if(!cancelled_message_ids.empty()) {
+          lock.unlock();
+          auto message_id=find_message_id(server_message_stream);
+          lock.lock();
+          cancelled=cancelled_message_ids.erase(message_id)>0;
+          server_message_stream.clear();
+          server_message_stream.seekg(server_message_content_pos, std::ios::beg);
+        }
+      }
+      
+      // Responses to cancelled requests are dropped without being parsed
+      if(!cancelled) {
+        boost::property_tree::ptree pt;
+        boost::property_tree::read_json(server_message_stream, pt);
+      
+        if(output_messages_and_errors) {
+          std::cout << "language server: ";
+          boost::property_tree::write_json(std::cout, pt);
+        }
+      
+        auto message_id=pt.get<size_t>("id", 0);
+        auto result_it=pt.find("result");
+        auto error_it=pt.find("error");
+        {
+          std::unique_lock<std::mutex> lock(read_write_mutex);
+          if(result_it!=pt.not_found()) {
+            if(message_id) {
+              if(auto function=extract_handler(message_id)) {
+                lock.unlock();
+                function(result_it->second, false);
+                lock.lock();
+              }
             }
           }
-        }
-        else if(error_it!=pt.not_found()) {
-          if(!output_messages_and_errors)
-            boost::property_tree::write_json(std::cerr, pt);
-          if(message_id) {
-            auto id_it=handlers.find(message_id);
-            if(id_it!=handlers.end()) {
-              auto function=std::move(id_it->second.second);
-              handlers.erase(id_it->first);
-              lock.unlock();
-              function(result_it->second, true);
-              lock.lock();
+          else if(error_it!=pt.not_found()) {
+            if(!output_messages_and_errors)
+              boost::property_tree::write_json(std::cerr, pt);
+            if(message_id) {
+              if(auto function=extract_handler(message_id)) {
+                lock.unlock();
+                function(error_it->second, true);
+                lock.lock();
+              }
             }
           }
-        }
-        else {
-          auto method_it=pt.find("method");
-          if(method_it!=pt.not_found()) {
-            auto params_it=pt.find("params");
-            if(params_it!=pt.not_found()) {
-              lock.unlock();
-              handle_server_request(method_it->second.get_value<std::string>(""), params_it->second);
-              lock.lock();
+          else {
+            auto method_it=pt.find("method");
+            if(method_it!=pt.not_found()) {
+              auto params_it=pt.find("params");
+              if(params_it!=pt.not_found()) {
+                lock.unlock();
+                handle_server_request(method_it->second.get_value<std::string>(""), params_it->second);
+                lock.lock();
+              }
             }
           }
         }
@@ -235,51 +473,133 @@ void LanguageProtocol::Client::parse_server_message() {
   }
 }
 
-void LanguageProtocol::Client::write_request(Source::LanguageProtocolView *view, const std::string &method, const std::string &params, std::function<void(const boost::property_tree::ptree &, bool error)> &&function) {
+size_t LanguageProtocol::Client::write_request(Source::LanguageProtocolView *view, const std::string &method, const std::string &params, std::function<void(const boost::property_tree::ptree &, bool error)> &&function, bool supersede, std::atomic<size_t> *request_id) {
   std::unique_lock<std::mutex> lock(read_write_mutex);
+  // After the language server has been restarted, requests are refused until the new initialize handshake is completed
+  if(!initialized && method!="initialize" && method!="shutdown") {
+    lock.unlock();
+    if(function)
+      function(boost::property_tree::ptree(), true);
+    return 0;
+  }
+  auto message_id=this->message_id++;
+  if(request_id)
+    *request_id=message_id;
+  size_t superseded_message_id=0;
+  if(supersede && view) {
+    auto &latest_message_id=latest_requests[view][method];
+    superseded_message_id=latest_message_id;
+    latest_message_id=message_id;
+  }
   if(function) {
     handlers.emplace(message_id, std::make_pair(view, std::move(function)));
-    
-    auto message_id=this->message_id;
-    std::unique_lock<std::mutex> lock(timeout_threads_mutex);
-    timeout_threads.emplace_back([this, message_id] {
-      for(size_t c=0;c<20;++c) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(500));
-        std::unique_lock<std::mutex> lock(read_write_mutex);
-        auto id_it=handlers.find(message_id);
-        if(id_it==handlers.end())
-          return;
-      }
-      std::unique_lock<std::mutex> lock(read_write_mutex);
-      auto id_it=handlers.find(message_id);
-      if(id_it!=handlers.end()) {
-        auto function=std::move(id_it->second.second);
-        handlers.erase(id_it->first);
-        lock.unlock();
-        function(boost::property_tree::ptree(), false);
-        lock.lock();
-      }
-    });
+    timeouts.emplace(message_id, std::chrono::steady_clock::now()+std::chrono::seconds(10));
+    if(timeouts.size()==1)
+      timeouts_condition_variable.notify_one();
   }
-  std::string content(R"({"jsonrpc":"2.0","id":)"+std::to_string(message_id++)+R"(,"method":")"+method+R"(","params":{)"+params+"}}");
+  std::string content(R"({"jsonrpc":"2.0","id":)"+std::to_string(message_id)+R"(,"method":")"+method+R"(","params":{)"+params+"}}");
   auto message="Content-Length: "+std::to_string(content.size())+"\r\n\r\n"+content;
   if(output_messages_and_errors)
     std::cout << "Language client: " << content << std::endl;
   if(!process->write(message)) {
-    Terminal::get().async_print("Error writing to language protocol server. Please close and reopen all project source files.\n", true);
-    auto id_it=handlers.find(message_id-1);
-    if(id_it!=handlers.end()) {
-      auto function=std::move(id_it->second.second);
-      handlers.erase(id_it->first);
+    if(!exited)
+      Terminal::get().async_print("Error writing to "+language_id+"-language-server.\n", true);
+    if(auto function=extract_handler(message_id)) {
       lock.unlock();
       function(boost::property_tree::ptree(), false);
       lock.lock();
     }
   }
+  lock.unlock();
+  if(superseded_message_id)
+    cancel_request(superseded_message_id);
+  return message_id;
+}
+
+void LanguageProtocol::Client::cancel_request(size_t message_id) {
+  std::unique_lock<std::mutex> lock(read_write_mutex);
+  auto function=extract_handler(message_id);
+  if(function)
+    add_cancelled_message_id(message_id);
+  lock.unlock();
+  if(function) {
+    write_notification("$/cancelRequest", "\"id\":"+std::to_string(message_id));
+    function(boost::property_tree::ptree(), true);
+  }
+}
+
+void LanguageProtocol::Client::add_cancelled_message_id(size_t message_id) {
+  cancelled_message_ids.emplace(message_id);
+  // Language servers should respond to cancelled requests, but limit the number of ids kept in case they do not
+  if(cancelled_message_ids.size()>100)
+    cancelled_message_ids.erase(cancelled_message_ids.begin());
+}
+
+size_t LanguageProtocol::Client::find_message_id(std::istream &stream) {
+  int depth=0;
+  bool inside_string=false;
+  bool escaped=false;
+  std::string key;
+  size_t message_id=0;
+  bool method_found=false;
+  char chr;
+  while(stream.get(chr)) {
+    if(inside_string) {
+      if(escaped)
+        escaped=false;
+      else if(chr=='\\')
+        escaped=true;
+      else if(chr=='"')
+        inside_string=false;
+      else if(depth==1 && key.size()<7)
+        key+=chr;
+    }
+    else if(chr=='"') {
+      inside_string=true;
+      key.clear();
+    }
+    else if(chr=='{' || chr=='[')
+      ++depth;
+    else if(chr=='}' || chr==']') {
+      if(--depth==0)
+        break;
+    }
+    else if(chr==':' && depth==1) {
+      if(key=="method")
+        method_found=true;
+      else if(key=="id") {
+        while(stream.get(chr)) {
+          if(chr>='0' && chr<='9')
+            message_id=message_id*10+static_cast<size_t>(chr-'0');
+          else if(chr!=' ' && chr!='\t' && chr!='\r' && chr!='\n') {
+            stream.unget();
+            break;
+          }
+        }
+      }
+      key.clear();
+    }
+  }
+  // Requests from the server have their own ids
+  return method_found?0:message_id;
+}
+
+std::function<void(const boost::property_tree::ptree &, bool)> LanguageProtocol::Client::extract_handler(size_t message_id) {
+  timeouts.erase(message_id);
+  auto id_it=handlers.find(message_id);
+  if(id_it==handlers.end())
+    return nullptr;
+  auto function=std::move(id_it->second.second);
+  handlers.erase(id_it);
+  return function;
 }
 
 void LanguageProtocol::Client::write_notification(const std::string &method, const std::string &params) {
   std::unique_lock<std::mutex> lock(read_write_mutex);
+  // Notifications about documents are dropped until the initialize handshake is completed,
+  // and the documents are opened again when the restarted language server is initialized
+  if(!initialized && method!="initialized" && method!="exit")
+    return;
   std::string content(R"({"jsonrpc":"2.0","method":")"+method+R"(","params":{)"+params+"}}");
   auto message="Content-Length: "+std::to_string(content.size())+"\r\n\r\n"+content;
   if(output_messages_and_errors)
@@ -319,6 +639,12 @@ void LanguageProtocol::Client::handle_server_request(const std::string &method,
 
 Source::LanguageProtocolView::LanguageProtocolView(const boost::filesystem::path &file_path, const Glib::RefPtr<Gsv::Language> &language, std::string language_id_)
     : Source::BaseView(file_path, language), Source::View(file_path, language), uri("file://"+file_path.string()), language_id(std::move(language_id_)), client(LanguageProtocol::Client::get(file_path, language_id)), autocomplete(this, interactive_completion, last_keyval, false) {
+  auto tag_table=get_buffer()->get_tag_table();
+  for(auto &style: semantic_token_styles()) {
+    if(!tag_table->lookup(style.second))
+      get_buffer()->create_tag(style.second);
+  }
+  
   configure();
   get_source_buffer()->set_language(language);
   get_source_buffer()->set_highlight_syntax(true);
@@ -351,9 +677,14 @@ Source::LanguageProtocolView::LanguageProtocolView(const boost::filesystem::path
     dispatcher.post([this, capabilities] {
       this->capabilities=capabilities;
       
-      std::string text=get_buffer()->get_text();
-      escape_text(text);
-      client->write_notification("textDocument/didOpen", R"("textDocument":{"uri":")"+uri+R"(","languageId":")"+language_id+R"(","version":)"+std::to_string(document_version++)+R"(,"text":")"+text+"\"}");
+      if(capabilities.semantic_tokens) {
+        for(auto &token_type: capabilities.semantic_token_types) {
+          auto it=semantic_token_styles().find(token_type);
+          semantic_tokens_tags.emplace_back(it!=semantic_token_styles().end()?get_buffer()->get_tag_table()->lookup(it->second):Glib::RefPtr<Gtk::TextTag>());
+        }
+      }
+      
+      write_did_open();
       
       setup_autocomplete();
       setup_navigation_and_refactoring();
@@ -369,6 +700,14 @@ Source::LanguageProtocolView::LanguageProtocolView(const boost::filesystem::path
   
   get_buffer()->signal_changed().connect([this] {
     get_buffer()->remove_tag(similar_symbol_tag, get_buffer()->begin(), get_buffer()->end());
+    
+    if(!semantic_tokens_tags.empty()) {
+      delayed_semantic_tokens_connection.disconnect();
+      delayed_semantic_tokens_connection=Glib::signal_timeout().connect([this]() {
+        update_semantic_tokens();
+        return false;
+      }, 500);
+    }
   });
   
   get_buffer()->signal_mark_set().connect([this](const Gtk::TextBuffer::iterator &iterator, const Glib::RefPtr<Gtk::TextBuffer::Mark> &mark) {
@@ -414,6 +753,8 @@ Source::LanguageProtocolView::LanguageProtocolView(const boost::filesystem::path
 }
 
 Source::LanguageProtocolView::~LanguageProtocolView() {
+  delayed_semantic_tokens_connection.disconnect();
+  
   if(initialize_thread.joinable())
     initialize_thread.join();
   
@@ -427,6 +768,47 @@ Source::LanguageProtocolView::~LanguageProtocolView() {
   client=nullptr;
 }
 
+void Source::LanguageProtocolView::reopen() {
+  dispatcher.post([this] {
+    write_did_open();
+  });
+}
+
+void Source::LanguageProtocolView::write_did_open() {
+  std::string text=get_buffer()->get_text();
+  escape_text(text);
+  client->write_notification("textDocument/didOpen", R"("textDocument":{"uri":")"+uri+R"(","languageId":")"+language_id+R"(","version":)"+std::to_string(document_version++)+R"(,"text":")"+text+"\"}");
+  
+  if(!semantic_tokens_tags.empty()) {
+    {
+      std::unique_lock<std::mutex> lock(semantic_tokens_mutex);
+      semantic_tokens_result_id.clear();
+      semantic_tokens_data.clear();
+      semantic_tokens_positions.clear();
+    }
+    update_semantic_tokens();
+  }
+}
+
+void Source::LanguageProtocolView::configure() {
+  Source::View::configure();
+  
+  auto scheme=get_source_buffer()->get_style_scheme();
+  auto tag_table=get_buffer()->get_tag_table();
+  for(auto &style_name: semantic_token_styles()) {
+    auto tag=tag_table->lookup(style_name.second);
+    if(tag) {
+      auto style=scheme->get_style(style_name.second);
+      if(style) {
+        if(style->property_foreground_set())
+          tag->property_foreground()=style->property_foreground();
+        if(style->property_background_set())
+          tag->property_background()=style->property_background();
+      }
+    }
+  }
+}
+
 bool Source::LanguageProtocolView::save() {
   if(!Source::View::save())
     return false;
@@ -1033,7 +1415,7 @@ void Source::LanguageProtocolView::show_type_tooltips(const Gdk::Rectangle &rect
         });
       }
     }
-  });
+  }, true);
 }
 
 void Source::LanguageProtocolView::tag_similar_symbols() {
@@ -1080,7 +1462,188 @@ void Source::LanguageProtocolView::tag_similar_symbols() {
         }
       });
     }
-  });
+  }, true);
+}
+
+const std::unordered_map<std::string, std::string> &Source::LanguageProtocolView::semantic_token_styles() {
+  static std::unordered_map<std::string, std::string> styles{
+      {"namespace", "def:type"},
+      {"type", "def:type"},
+      {"class", "def:type"},
+      {"enum", "def:type"},
+      {"interface", "def:type"},
+      {"struct", "def:type"},
+      {"typeParameter", "def:type"},
+      {"parameter", "def:identifier"},
+      {"variable", "def:identifier"},
+      {"property", "def:identifier"},
+      {"enumMember", "def:identifier"},
+      {"function", "def:function"},
+      {"method", "def:function"},
+      {"macro", "def:function"},
+      {"keyword", "def:statement"},
+      {"modifier", "def:statement"},
+      {"comment", "def:comment"},
+      {"string", "def:string"},
+      {"regexp", "def:string"},
+      {"number", "def:number"}
+  };
+  return styles;
+}
+
+void Source::LanguageProtocolView::update_semantic_tokens() {
+  std::string previous_result_id;
+  if(capabilities.semantic_tokens_delta) {
+    std::unique_lock<std::mutex> lock(semantic_tokens_mutex);
+    previous_result_id=semantic_tokens_result_id;
+  }
+  std::string method, params=R"("textDocument":{"uri":")"+uri+"\"}";
+  if(!previous_result_id.empty()) {
+    method="textDocument/semanticTokens/full/delta";
+    params+=R"(,"previousResultId":")"+previous_result_id+"\"";
+  }
+  else
+    method="textDocument/semanticTokens/full";
+  
+  // The tokens are decoded in the thread receiving the response, and only the changed region is posted to the main thread
+  auto version=document_version;
+  client->write_request(this, method, params, [this, previous_result_id, version](const boost::property_tree::ptree &result, bool error) {
+    if(error)
+      return;
+    
+    const auto get_data=[](const boost::property_tree::ptree &pt) {
+      std::vector<unsigned> data;
+      data.reserve(pt.size());
+      for(auto &value: pt)
+        data.emplace_back(value.second.get_value<unsigned>(0));
+      return data;
+    };
+    
+    std::unique_lock<std::mutex> lock(semantic_tokens_mutex);
+    bool full;
+    size_t start=0, end=0; // Range of changed integers in semantic_tokens_data
+    auto data_it=result.find("data");
+    auto edits_it=result.find("edits");
+    if(data_it!=result.not_found()) {
+      semantic_tokens_data=get_data(data_it->second);
+      semantic_tokens_positions.clear();
+      full=true;
+    }
+    else if(edits_it!=result.not_found()) {
+      if(previous_result_id.empty() || previous_result_id!=semantic_tokens_result_id) {
+        // Edits are relative to tokens that have since been replaced, so request all the tokens
+        semantic_tokens_result_id.clear();
+        lock.unlock();
+        dispatcher.post([this] {
+          if(!delayed_semantic_tokens_connection.connected())
+            update_semantic_tokens();
+        });
+        return;
+      }
+      class Edit {
+      public:
+        size_t start, delete_count;
+        std::vector<unsigned> data;
+      };
+      std::vector<Edit> edits;
+      for(auto &edit: edits_it->second)
+        edits.emplace_back(Edit{edit.second.get<size_t>("start", 0), edit.second.get<size_t>("deleteCount", 0), get_data(edit.second.get_child("data", boost::property_tree::ptree()))});
+      if(edits.empty()) {
+        semantic_tokens_result_id=result.get<std::string>("resultId", "");
+        return;
+      }
+      std::sort(edits.begin(), edits.end(), [](const Edit &a, const Edit &b) {
+        return a.start<b.start;
+      });
+      start=std::min(edits.front().start, semantic_tokens_data.size());
+      end=edits.back().start+edits.back().data.size();
+      // Edits are applied from the back so that the start indices remain valid
+      for(auto it=edits.rbegin();it!=edits.rend();++it) {
+        auto edit_start=std::min(it->start, semantic_tokens_data.size());
+        auto edit_end=std::min(edit_start+it->delete_count, semantic_tokens_data.size());
+        semantic_tokens_data.erase(semantic_tokens_data.begin()+edit_start, semantic_tokens_data.begin()+edit_end);
+        semantic_tokens_data.insert(semantic_tokens_data.begin()+edit_start, it->data.begin(), it->data.end());
+        if(it!=edits.rbegin())
+          end+=it->data.size()-(edit_end-edit_start);
+      }
+      semantic_tokens_positions.resize(std::min(semantic_tokens_positions.size(), start/5));
+      full=false;
+    }
+    else
+      return;
+    semantic_tokens_result_id=result.get<std::string>("resultId", "");
+    
+    // Token indices of the changed range. The tokens on each side give the region boundaries.
+    size_t token_count=semantic_tokens_data.size()/5;
+    size_t start_token=full?0:start/5, end_token=full?token_count:std::min((end+4)/5, token_count);
+    decode_semantic_tokens_positions(end_token+1);
+    std::pair<Offset, Offset> region(Offset(0, 0), Offset(std::numeric_limits<unsigned>::max(), std::numeric_limits<unsigned>::max()));
+    if(start_token>0) {
+      auto &position=semantic_tokens_positions[start_token-1];
+      region.first=Offset(position.first, position.second+semantic_tokens_data[(start_token-1)*5+2]);
+    }
+    if(end_token<token_count)
+      region.second=Offset(semantic_tokens_positions[end_token].first, semantic_tokens_positions[end_token].second);
+    std::vector<SemanticToken> tokens;
+    tokens.reserve(end_token-start_token);
+    for(auto token=start_token;token<end_token;++token) {
+      auto &position=semantic_tokens_positions[token];
+      tokens.emplace_back(SemanticToken{position.first, position.second, semantic_tokens_data[token*5+2], semantic_tokens_data[token*5+3]});
+    }
+    lock.unlock();
+    
+    dispatcher.post([this, region, tokens=std::move(tokens), full, version] {
+      // The tokens do not match a buffer that has been changed since the request, so request all the tokens again,
+      // either now or through the pending delayed update
+      if(version!=document_version) {
+        {
+          std::unique_lock<std::mutex> lock(semantic_tokens_mutex);
+          semantic_tokens_result_id.clear();
+        }
+        if(!delayed_semantic_tokens_connection.connected())
+          update_semantic_tokens();
+        return;
+      }
+      apply_semantic_tokens(region, tokens, full);
+    });
+  }, true);
+}
+
+void Source::LanguageProtocolView::decode_semantic_tokens_positions(size_t end_token) {
+  end_token=std::min(end_token, semantic_tokens_data.size()/5);
+  if(semantic_tokens_positions.size()>=end_token)
+    return;
+  semantic_tokens_positions.reserve(semantic_tokens_data.size()/5);
+  unsigned line=0, character=0;
+  if(!semantic_tokens_positions.empty()) {
+    line=semantic_tokens_positions.back().first;
+    character=semantic_tokens_positions.back().second;
+  }
+  for(auto c=semantic_tokens_positions.size()*5;c<end_token*5;c+=5) {
+    if(semantic_tokens_data[c]!=0) {
+      line+=semantic_tokens_data[c];
+      character=semantic_tokens_data[c+1];
+    }
+    else
+      character+=semantic_tokens_data[c+1];
+    semantic_tokens_positions.emplace_back(line, character);
+  }
+}
+
+void Source::LanguageProtocolView::apply_semantic_tokens(const std::pair<Offset, Offset> &region, const std::vector<SemanticToken> &tokens, bool full) {
+  auto region_start=full?get_buffer()->begin():get_iter_at_line_pos(region.first.line, region.first.index);
+  auto region_end=full || region.second.line==std::numeric_limits<unsigned>::max()?get_buffer()->end():get_iter_at_line_pos(region.second.line, region.second.index);
+  for(auto &tag: semantic_tokens_tags) {
+    if(tag)
+      get_buffer()->remove_tag(tag, region_start, region_end);
+  }
+  for(auto &token: tokens) {
+    if(token.type<semantic_tokens_tags.size() && semantic_tokens_tags[token.type]) {
+      auto start=get_iter_at_line_pos(token.line, token.character);
+      auto end=get_iter_at_line_pos(token.line, token.character+token.length);
+      get_buffer()->apply_tag(semantic_tokens_tags[token.type], start, end);
+    }
+  }
 }
 
 Source::Offset Source::LanguageProtocolView::get_declaration(const Gtk::TextIter &iter) {
@@ -1262,11 +1825,16 @@ void Source::LanguageProtocolView::setup_autocomplete() {
           }
         }
         result_processed.set_value();
-      });
+      }, true, &autocomplete_request_id);
       result_processed.get_future().get();
+      autocomplete_request_id=0;
     }
   };
   
+  get_buffer()->signal_changed().connect([this] {
+    cancel_autocomplete_request();
+  });
+  
   signal_key_press_event().connect([this](GdkEventKey *event) {
     if((event->keyval==GDK_KEY_Tab || event->keyval==GDK_KEY_ISO_Left_Tab) && (event->state&GDK_SHIFT_MASK)==0) {
       if(!autocomplete_marks.empty()) {
@@ -1289,6 +1857,7 @@ void Source::LanguageProtocolView::setup_autocomplete() {
   
   get_buffer()->signal_mark_set().connect([this](const Gtk::TextBuffer::iterator &iterator, const Glib::RefPtr<Gtk::TextBuffer::Mark> &mark) {
     if(mark->get_name() == "insert") {
+      cancel_autocomplete_request();
       if(!autocomplete_keep_marks) {
         for(auto &pair: autocomplete_marks) {
           get_buffer()->delete_mark(pair.first);
@@ -1374,6 +1943,14 @@ void Source::LanguageProtocolView::setup_autocomplete() {
   };
 }
 
+void Source::LanguageProtocolView::cancel_autocomplete_request() {
+  // Autocomplete::stop() has already been called from the same signals
+  if(autocomplete.state==Autocomplete::State::CANCELED) {
+    if(auto message_id=autocomplete_request_id.exchange(0))
+      client->cancel_request(message_id);
+  }
+}
+
 void Source::LanguageProtocolView::add_flow_coverage_tooltips(bool called_in_thread) {
   std::stringstream stdin_stream, stderr_stream;
   auto stdout_stream=std::make_shared<std::stringstream>();
@@ -3,8 +3,13 @@
 #include "process.hpp"
 #include "source.h"
 #include <boost/property_tree/json_parser.hpp>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <list>
+#include <map>
 #include <mutex>
+#include <set>
 #include <sstream>
 #include <unordered_map>
 #include <unordered_set>
@@ -14,6 +19,9 @@ namespace Source {
 }
 
 namespace LanguageProtocol {
+  /// Returns the language id used to find a language server for file_path, or an empty string if language is not set or is handled by Source::ClangView
+  std::string get_language_id(const boost::filesystem::path &file_path, const Glib::RefPtr<Gsv::Language> &language);
+  
   class Diagnostic {
   public:
     std::string spelling;
@@ -37,6 +45,9 @@ namespace LanguageProtocol {
     bool document_formatting;
     bool document_range_formatting;
     bool rename;
+    bool semantic_tokens;
+    bool semantic_tokens_delta;
+    std::vector<std::string> semantic_token_types;
   };
 
   class Client {
@@ -52,7 +63,33 @@ namespace LanguageProtocol {
     std::mutex initialize_mutex;
 
     std::unique_ptr<TinyProcessLib::Process> process;
+    std::chrono::steady_clock::time_point process_start_time;
     std::mutex read_write_mutex;
+    void start_process();
+    
+    /// Set by shutdown(), to avoid restarting the language server on exit
+    bool shutting_down = false;
+    /// The language server is killed by timeout_thread if it has not exited at this time
+    std::chrono::steady_clock::time_point kill_deadline = std::chrono::steady_clock::time_point::max();
+    /// Set when the language server has exited, and will not be restarted
+    bool exited = false;
+    /// Waits for the language server to exit, and restarts it if it exited unexpectedly
+    std::thread exit_thread;
+    
+    /// Called instead of delete when the last reference to the client is released.
+    /// Does not block: sends shutdown and exit to the language server, and moves the client to shut_down_clients.
+    void shutdown();
+    /// Clients that have been shut down, and are deleted by delete_shut_down_clients() when their language server has exited
+    static std::vector<std::unique_ptr<Client>> shut_down_clients;
+    static std::mutex shut_down_clients_mutex;
+    /// Deletes the shut down clients whose language server has exited. If wait is true, all the shut down clients are deleted,
+    /// and language servers that have not exited within a couple of seconds are killed.
+    static void delete_shut_down_clients(bool wait);
+    
+    /// Time when the client was last in use, protected by views_mutex
+    std::chrono::steady_clock::time_point last_used;
+    static std::unordered_map<std::string, std::shared_ptr<Client>> cache;
+    static std::mutex cache_mutex;
 
     std::stringstream server_message_stream;
     size_t server_message_size = static_cast<size_t>(-1);
@@ -62,20 +99,49 @@ namespace LanguageProtocol {
     size_t message_id = 1;
 
     std::unordered_map<size_t, std::pair<Source::LanguageProtocolView*, std::function<void(const boost::property_tree::ptree &, bool error)>>> handlers;
-    std::vector<std::thread> timeout_threads;
-    std::mutex timeout_threads_mutex;
+    /// Request deadlines ordered by message id. Since all requests have the same timeout, the first element expires first.
+    std::map<size_t, std::chrono::steady_clock::time_point> timeouts;
+    std::condition_variable timeouts_condition_variable;
+    bool timeout_thread_stop = false;
+    /// Single thread calling the handlers of requests that have timed out, and killing the language server at kill_deadline
+    std::thread timeout_thread;
+    
+    /// Latest request per view and method, used to cancel superseded requests
+    std::unordered_map<Source::LanguageProtocolView *, std::unordered_map<std::string, size_t>> latest_requests;
+    /// Ids of cancelled requests whose responses should be dropped
+    std::set<size_t> cancelled_message_ids;
+    
+    /// read_write_mutex must be locked. Returns nullptr if the request is no longer pending.
+    std::function<void(const boost::property_tree::ptree &, bool)> extract_handler(size_t message_id);
+    /// read_write_mutex must be locked. Used for requests that are cancelled or have timed out.
+    void add_cancelled_message_id(size_t message_id);
+    /// Returns the id of a response from the server without parsing the message, or 0 if not found or if the message is a request from the server
+    static size_t find_message_id(std::istream &stream);
 
   public:
+    /// Must be called from the main thread
     static std::shared_ptr<Client> get(const boost::filesystem::path &file_path, const std::string &language_id);
+    /// Starts language servers for the languages found in directory, before any files are opened
+    static void prespawn(const boost::filesystem::path &directory);
+    /// Shuts down language servers that have not been in use the last few minutes, or all unused servers if all is true.
+    /// If all is true, also waits for the shut down language servers to exit.
+    static void shutdown_idle(bool all = false);
 
     ~Client();
 
+    /// Set when the initialize handshake with the language server has completed, protected by read_write_mutex.
+    /// Until then, requests other than initialize and shutdown are refused, and notifications other than initialized and exit are dropped.
     bool initialized = false;
     Capabilities initialize(Source::LanguageProtocolView *view);
     void close(Source::LanguageProtocolView *view);
     
     void parse_server_message();
-    void write_request(Source::LanguageProtocolView *view, const std::string &method, const std::string &params, std::function<void(const boost::property_tree::ptree &, bool)> &&function = nullptr);
+    /// Returns the message id of the request, which can be used in cancel_request().
+    /// If supersede is true, the previous request from view with the same method is cancelled.
+    /// If request_id is set, it is assigned the message id before the request is written, so that the request can be cancelled while waiting for the response.
+    size_t write_request(Source::LanguageProtocolView *view, const std::string &method, const std::string &params, std::function<void(const boost::property_tree::ptree &, bool)> &&function = nullptr, bool supersede = false, std::atomic<size_t> *request_id = nullptr);
+    /// Sends $/cancelRequest, and calls the request handler with error set to true if the request is still pending
+    void cancel_request(size_t message_id);
     void write_notification(const std::string &method, const std::string &params);
     void handle_server_request(const std::string &method, const boost::property_tree::ptree &params);
   };
@@ -91,8 +157,12 @@ namespace Source {
     bool save() override;
 
     void update_diagnostics(std::vector<LanguageProtocol::Diagnostic> &&diagnostics);
+    /// Sends the document to the language server again, for instance after it has been restarted
+    void reopen();
     
     Gtk::TextIter get_iter_at_line_pos(int line, int pos) override;
+    
+    void configure() override;
 
   protected:
     void show_type_tooltips(const Gdk::Rectangle &rectangle) override;
@@ -108,6 +178,8 @@ namespace Source {
     std::thread initialize_thread;
     Dispatcher dispatcher;
     
+    void write_did_open();
+    
     void setup_navigation_and_refactoring();
 
     void escape_text(std::string &text);
@@ -115,10 +187,36 @@ namespace Source {
     
     void tag_similar_symbols();
     
+    class SemanticToken {
+    public:
+      unsigned line, character, length, type;
+    };
+    /// Style names of the supported semantic token types
+    static const std::unordered_map<std::string, std::string> &semantic_token_styles();
+    /// Tags indexed by the token types of the language server legend, nullptr for unsupported types
+    std::vector<Glib::RefPtr<Gtk::TextTag>> semantic_tokens_tags;
+    /// Protects the semantic tokens state below, which is updated in the language server response handlers
+    std::mutex semantic_tokens_mutex;
+    std::string semantic_tokens_result_id;
+    std::vector<unsigned> semantic_tokens_data;
+    /// Decoded line and character of the first tokens in semantic_tokens_data. Positions after an edit are removed,
+    /// and are decoded again only when needed, so that a delta is decoded from the edit and not from the first token.
+    std::vector<std::pair<unsigned, unsigned>> semantic_tokens_positions;
+    /// semantic_tokens_mutex must be locked. Decodes the positions of the tokens before end_token that have not been decoded.
+    void decode_semantic_tokens_positions(size_t end_token);
+    sigc::connection delayed_semantic_tokens_connection;
+    void update_semantic_tokens();
+    /// Replaces the semantic token tags between start and end, and must be called from the main thread
+    void apply_semantic_tokens(const std::pair<Offset, Offset> &region, const std::vector<SemanticToken> &tokens, bool full);
+    
     Offset get_declaration(const Gtk::TextIter &iter);
 
     Autocomplete autocomplete;
     void setup_autocomplete();
+    /// Id of the pending completion request, or 0
+    std::atomic<size_t> autocomplete_request_id = {0};
+    /// Cancels the pending completion request if autocomplete has been stopped
+    void cancel_autocomplete_request();
     std::vector<std::string> autocomplete_comment;
     std::vector<std::string> autocomplete_insert;
     std::list<std::pair<Glib::RefPtr<Gtk::TextBuffer::Mark>, Glib::RefPtr<Gtk::TextBuffer::Mark>>> autocomplete_marks;
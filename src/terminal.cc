@@ -5,8 +5,9 @@
 #include "notebook.h"
 #include "filesystem.h"
 #include <iostream>
-#include <regex>
+#include <cstring>
 #include <thread>
+#include <algorithm>
 
 Terminal::Terminal() {
   set_editable(false);
@@ -19,6 +20,94 @@ Terminal::Terminal() {
   
   link_mouse_cursor=Gdk::Cursor::create(Gdk::CursorType::HAND1);
   default_mouse_cursor=Gdk::Cursor::create(Gdk::CursorType::XTERM);
+  
+  // Lines from the history are shown when scrolling to the top or bottom of the terminal
+  property_vadjustment().signal_changed().connect([this] {
+    auto adjustment=get_vadjustment();
+    if(!adjustment)
+      return;
+    vadjustment_value_changed_connection.disconnect();
+    vadjustment_value_changed_connection=adjustment->signal_value_changed().connect([this, adjustment] {
+      if(showing_history)
+        return;
+      if(adjustment->get_value()<=adjustment->get_lower() && adjustment->get_upper()>adjustment->get_page_size())
+        show_earlier_lines();
+      else if(!following_output && adjustment->get_value()+adjustment->get_page_size()>=adjustment->get_upper())
+        show_later_lines();
+    });
+  });
+}
+
+const size_t Terminal::History::chunk_size;
+
+void Terminal::History::append(const std::string &message, bool bold) {
+  if(chunks.empty()) {
+    chunks.emplace_back();
+    chunks.back().line_ends.emplace_back(0);
+    chunks.back().bold_lines.emplace_back(false);
+  }
+  
+  size_t pos=0;
+  for(;;) {
+    auto line_end=message.find('\n', pos);
+    auto text_end=line_end!=std::string::npos?line_end:message.size();
+    if(text_end>pos) {
+      auto &chunk=chunks.back();
+      chunk.text.append(message, pos, text_end-pos);
+      chunk.line_ends.back()=chunk.text.size();
+      if(bold)
+        chunk.bold_lines.back()=true;
+    }
+    if(line_end==std::string::npos)
+      break;
+    
+    ++newline_count;
+    if(chunks.back().line_ends.size()>=chunk_size)
+      chunks.emplace_back();
+    auto &chunk=chunks.back();
+    chunk.line_ends.emplace_back(chunk.text.size());
+    chunk.bold_lines.emplace_back(false);
+    pos=line_end+1;
+  }
+  
+  while(chunks.size()>1 && newline_count+1-first_line_nr-chunks.front().line_ends.size()>=max_lines) {
+    first_line_nr+=chunks.front().line_ends.size();
+    chunks.pop_front();
+  }
+}
+
+void Terminal::History::append_to_line(size_t line_nr, const std::string &message) {
+  if(line_nr<first_line_nr || line_nr>newline_count || chunks.empty())
+    return;
+  auto &chunk=chunks[(line_nr-first_line_nr)/chunk_size];
+  auto index=(line_nr-first_line_nr)%chunk_size;
+  chunk.text.insert(chunk.line_ends[index], message);
+  for(;index<chunk.line_ends.size();++index)
+    chunk.line_ends[index]+=message.size();
+}
+
+void Terminal::History::clear() {
+  chunks.clear();
+  first_line_nr=newline_count;
+}
+
+std::list<std::pair<std::string, bool>> Terminal::History::get_lines(size_t first, size_t last) const {
+  std::list<std::pair<std::string, bool>> lines;
+  first=std::max(first, first_line_nr);
+  last=std::min(last, newline_count);
+  for(auto line_nr=first;line_nr<=last && !chunks.empty();++line_nr) {
+    // All chunks but the last one are full
+    auto &chunk=chunks[(line_nr-first_line_nr)/chunk_size];
+    auto index=(line_nr-first_line_nr)%chunk_size;
+    auto start=index>0?chunk.line_ends[index-1]:0;
+    bool bold=chunk.bold_lines[index];
+    if(lines.empty() || lines.back().second!=bold)
+      lines.emplace_back(std::string(), bold);
+    lines.back().first.append(chunk.text, start, chunk.line_ends[index]-start);
+    if(line_nr<last)
+      lines.back().first+='\n';
+  }
+  return lines;
 }
 
 int Terminal::process(const std::string &command, const boost::filesystem::path &path, bool use_pipes) {  
@@ -77,18 +166,39 @@ int Terminal::process(std::istream &stdin_stream, std::ostream &stdout_stream, c
   return process.get_exit_status();
 }
 
-void Terminal::async_process(const std::string &command, const boost::filesystem::path &path, const std::function<void(int exit_status)> &callback, bool quiet) {
-  std::thread async_execute_thread([this, command, path, callback, quiet]() {
+size_t Terminal::async_process(const std::string &command, const boost::filesystem::path &path, const std::function<void(int exit_status)> &callback, bool quiet, bool parse_diagnostics) {
+  std::unique_lock<std::mutex> lock(processes_mutex);
+  auto id=++last_process_id;
+  starting_processes.emplace(id, false);
+  lock.unlock();
+  
+  std::thread async_execute_thread([this, id, command, path, callback, quiet, parse_diagnostics]() {
     std::unique_lock<std::mutex> processes_lock(processes_mutex);
     stdin_buffer.clear();
-    auto process=std::make_shared<TinyProcessLib::Process>(command, path.string(), [this, quiet](const char* bytes, size_t n) {
-      if(!quiet)
-        async_print(std::string(bytes, n));
-    }, [this, quiet](const char* bytes, size_t n) {
-      if(!quiet)
-        async_print(std::string(bytes, n), true);
+    BuildDiagnostics::Parser stdout_parser(path), stderr_parser(path);
+    auto process=std::make_shared<TinyProcessLib::Process>(command, path.string(), [this, quiet, parse_diagnostics, &stdout_parser](const char* bytes, size_t n) {
+      if(!quiet) {
+        async_print_process_output(std::string(bytes, n));
+        if(!parse_diagnostics)
+          return;
+        auto progress=stdout_parser.progress;
+        async_add_build_diagnostics(stdout_parser.parse(bytes, n));
+        if(stdout_parser.progress!=progress) {
+          dispatcher.post([progress=stdout_parser.progress] {
+            BuildDiagnostics::get().set_progress(progress);
+          });
+        }
+      }
+    }, [this, quiet, parse_diagnostics, &stderr_parser](const char* bytes, size_t n) {
+      if(!quiet) {
+        async_print_process_output(std::string(bytes, n), true);
+        if(parse_diagnostics)
+          async_add_build_diagnostics(stderr_parser.parse(bytes, n));
+      }
     }, true);
     auto pid=process->get_id();
+    auto killed=starting_processes[id];
+    starting_processes.erase(id);
     if (pid<=0) {
       processes_lock.unlock();
       async_print("Error: failed to run command: " + command + "\n", true);
@@ -98,10 +208,17 @@ void Terminal::async_process(const std::string &command, const boost::filesystem
     }
     else {
       processes.emplace_back(process);
+      processes_by_id.emplace(id, process);
+      if(killed)
+        process->kill();
       processes_lock.unlock();
     }
       
     auto exit_status=process->get_exit_status();
+    if(!quiet) {
+      async_add_build_diagnostics(stdout_parser.finish());
+      async_add_build_diagnostics(stderr_parser.finish());
+    }
     
     processes_lock.lock();
     for(auto it=processes.begin();it!=processes.end();it++) {
@@ -110,6 +227,7 @@ void Terminal::async_process(const std::string &command, const boost::filesystem
         break;
       }
     }
+    processes_by_id.erase(id);
     stdin_buffer.clear();
     processes_lock.unlock();
       
@@ -117,6 +235,27 @@ void Terminal::async_process(const std::string &command, const boost::filesystem
       callback(exit_status);
   });
   async_execute_thread.detach();
+  return id;
+}
+
+void Terminal::async_add_build_diagnostics(std::vector<BuildDiagnostics::Diagnostic> &&diagnostics) {
+  if(diagnostics.empty())
+    return;
+  dispatcher.post([diagnostics=std::move(diagnostics)]() mutable {
+    BuildDiagnostics::get().add(std::move(diagnostics));
+  });
+}
+
+void Terminal::kill_async_process(size_t id, bool force) {
+  std::unique_lock<std::mutex> lock(processes_mutex);
+  auto it=processes_by_id.find(id);
+  if(it!=processes_by_id.end())
+    it->second->kill(force);
+  else {
+    auto it=starting_processes.find(id);
+    if(it!=starting_processes.end())
+      it->second=true;
+  }
 }
 
 void Terminal::kill_last_async_process(bool force) {
@@ -164,74 +303,151 @@ bool Terminal::on_motion_notify_event(GdkEventMotion *event) {
 }
 
 std::tuple<size_t, size_t, std::string, std::string, std::string> Terminal::find_link(const std::string &line) {
-  const static std::regex link_regex("^([A-Z]:)?([^:]+):([0-9]+):([0-9]+): .*$|" //compile warning/error/rename usages
-                                     "^Assertion failed: .*file ([A-Z]:)?([^:]+), line ([0-9]+)\\.$|" //clang assert()
-                                     "^[^:]*: ([A-Z]:)?([^:]+):([0-9]+): .* Assertion .* failed\\.$|" //gcc assert()
-                                     "^ERROR:([A-Z]:)?([^:]+):([0-9]+):.*$"); //g_assert (glib.h)
-  size_t start_position=-1, end_position=-1;
-  std::string path, line_number, line_offset;
-  std::smatch sm;
-  if(std::regex_match(line, sm, link_regex)) {
-    for(size_t sub=1;sub<link_regex.mark_count();) {
-      size_t subs=sub==1?4:3;
-      if(sm.length(sub+1)) {
-        start_position=sm.position(sub+1)-sm.length(sub);
-        end_position=sm.position(sub+subs-1)+sm.length(sub+subs-1);
-        if(sm.length(sub))
-          path+=sm[sub].str();
-        path+=sm[sub+1].str();
-        line_number=sm[sub+2].str();
-        line_offset=subs==4?sm[sub+3].str():"1";
-        break;
+  // Recognizes the following formats, where [A-Z]: is an optional drive letter:
+  //   <path>:<line>:<column>: ...                       compile warning/error/rename usages
+  //   Assertion failed: ...file <path>, line <line>.    clang assert()
+  //   ...: <path>:<line>: ... Assertion ... failed.     gcc assert()
+  //   ERROR:<path>:<line>:...                           g_assert (glib.h)
+  auto starts_with=[&line](size_t pos, const char *text) {
+    auto size=std::strlen(text);
+    return pos+size<=line.size() && line.compare(pos, size, text)==0;
+  };
+  auto digits_end=[&line](size_t pos) {
+    while(pos<line.size() && line[pos]>='0' && line[pos]<='9')
+      ++pos;
+    return pos;
+  };
+  auto has_drive=[&line](size_t pos) {
+    return pos+1<line.size() && line[pos]>='A' && line[pos]<='Z' && line[pos+1]==':';
+  };
+  // Matches <path>:<line> at pos, where path must not contain ':'
+  auto match_path_and_line=[&](size_t pos, bool drive, size_t &path_end, size_t &line_end) {
+    auto path_start=pos+(drive?2:0);
+    path_end=line.find(':', path_start);
+    if(path_end==std::string::npos || path_end==path_start)
+      return false;
+    line_end=digits_end(path_end+1);
+    return line_end>path_end+1;
+  };
+  auto make_link=[&line](size_t path_start, size_t path_end, size_t line_end, size_t end_position, const std::string &line_offset) {
+    return std::make_tuple(path_start, end_position, line.substr(path_start, path_end-path_start),
+                           line.substr(path_end+1, line_end-path_end-1), line_offset);
+  };
+  
+  size_t path_end, line_end;
+  for(auto drive: {true, false}) {
+    if(drive && !has_drive(0))
+      continue;
+    if(match_path_and_line(0, drive, path_end, line_end) && line_end<line.size() && line[line_end]==':') {
+      auto offset_end=digits_end(line_end+1);
+      if(offset_end>line_end+1 && starts_with(offset_end, ": "))
+        return make_link(0, path_end, line_end, offset_end, line.substr(line_end+1, offset_end-line_end-1));
+    }
+  }
+  
+  if(starts_with(0, "Assertion failed: ") && line.size()>1 && line.back()=='.') {
+    auto line_start=line.size()-1;
+    while(line_start>0 && line[line_start-1]>='0' && line[line_start-1]<='9')
+      --line_start;
+    if(line_start<line.size()-1 && line_start>=7 && line.compare(line_start-7, 7, ", line ")==0) {
+      path_end=line_start-7;
+      for(auto pos=line.rfind("file ", path_end);pos!=std::string::npos && pos>=18;pos=pos>0?line.rfind("file ", pos-1):std::string::npos) {
+        auto path_start=pos+5;
+        for(auto drive: {true, false}) {
+          if(drive && !has_drive(path_start))
+            continue;
+          auto path_no_drive_start=path_start+(drive?2:0);
+          if(path_no_drive_start<path_end && line.find(':', path_no_drive_start)>=path_end)
+            return std::make_tuple(path_start, line.size()-1, line.substr(path_start, path_end-path_start),
+                                   line.substr(line_start, line.size()-1-line_start), std::string("1"));
+        }
       }
-      sub+=subs;
     }
   }
-  return std::make_tuple(start_position, end_position, path, line_number, line_offset);
+  
+  auto pos=line.find(':');
+  if(pos!=std::string::npos && starts_with(pos, ": ")) {
+    pos+=2;
+    const std::string failed=" failed.";
+    if(line.size()>=failed.size() && line.compare(line.size()-failed.size(), failed.size(), failed)==0) {
+      for(auto drive: {true, false}) {
+        if(drive && !has_drive(pos))
+          continue;
+        if(match_path_and_line(pos, drive, path_end, line_end) && starts_with(line_end, ": ")) {
+          auto message_start=line_end+2;
+          auto message_end=line.size()-failed.size();
+          auto assertion_pos=line.find(" Assertion ", message_start);
+          if(message_start<=message_end && assertion_pos!=std::string::npos && assertion_pos+11<=message_end)
+            return make_link(pos, path_end, line_end, line_end, "1");
+        }
+      }
+    }
+  }
+  
+  if(starts_with(0, "ERROR:")) {
+    for(auto drive: {true, false}) {
+      if(drive && !has_drive(6))
+        continue;
+      if(match_path_and_line(6, drive, path_end, line_end) && line_end<line.size() && line[line_end]==':')
+        return make_link(6, path_end, line_end, line_end, "1");
+    }
+  }
+  
+  return std::make_tuple(static_cast<size_t>(-1), static_cast<size_t>(-1), std::string(), std::string(), std::string());
 }
 
 void Terminal::apply_link_tags(const Gtk::TextIter &start_iter, const Gtk::TextIter &end_iter) {
-  auto iter=start_iter;
-  Gtk::TextIter line_start;
-  bool line_start_set=false;
+  auto text=get_buffer()->get_text(start_iter, end_iter);
+  auto &bytes=text.raw();
+  auto utf8_length=[&bytes](size_t start, size_t end) {
+    int length=0;
+    for(;start<end;++start) {
+      if((static_cast<unsigned char>(bytes[start])&0xC0)!=0x80)
+        ++length;
+    }
+    return length;
+  };
+  
+  // Only complete lines containing a path delimiter, a dot and a number are searched for links
+  int line_offset=start_iter.get_offset();
+  size_t line_start=0;
   bool delimiter_found=false;
   bool dot_found=false;
   bool number_found=false;
-  do {
-    if(iter.starts_line()) {
-      line_start=iter;
-      line_start_set=true;
+  for(size_t i=0;i<bytes.size();++i) {
+    auto chr=bytes[i];
+    if(chr=='\n') {
+      if(delimiter_found && dot_found && number_found) {
+        auto line_end=i>line_start && bytes[i-1]=='\r'?i-1:i;
+        auto link=find_link(bytes.substr(line_start, line_end-line_start));
+        if(std::get<0>(link)!=static_cast<size_t>(-1)) {
+          auto link_start=line_offset+utf8_length(line_start, line_start+std::get<0>(link));
+          auto link_end=link_start+utf8_length(line_start+std::get<0>(link), line_start+std::get<1>(link));
+          get_buffer()->apply_tag(link_tag, get_buffer()->get_iter_at_offset(link_start), get_buffer()->get_iter_at_offset(link_end));
+        }
+      }
+      line_offset+=utf8_length(line_start, i)+1;
+      line_start=i+1;
       delimiter_found=false;
       dot_found=false;
       number_found=false;
     }
-    if(line_start_set && (*iter=='\\' || *iter=='/'))
+    else if(chr=='\\' || chr=='/')
       delimiter_found=true;
-    else if(line_start_set && *iter=='.')
+    else if(chr=='.')
       dot_found=true;
-    else if(line_start_set && (*iter>='0' && *iter<='9'))
+    else if(chr>='0' && chr<='9')
       number_found=true;
-    else if(line_start_set && delimiter_found && dot_found && number_found && iter.ends_line()) {
-      auto line=get_buffer()->get_text(line_start, iter);
-      //Convert to ascii for std::regex and Gtk::Iter::forward_chars
-      for(size_t c=0;c<line.size();++c) {
-        if(line[c]>127)
-          line.replace(c, 1, "a");
-      }
-      auto link=find_link(line.raw());
-      if(std::get<0>(link)!=static_cast<size_t>(-1)) {
-        auto link_start=line_start;
-        auto link_end=line_start;
-        link_start.forward_chars(std::get<0>(link));
-        link_end.forward_chars(std::get<1>(link));
-        get_buffer()->apply_tag(link_tag, link_start, link_end);
-      }
-      line_start_set=false;
-    }
-  } while(iter.forward_char() && iter!=end_iter);
+  }
 }
 
 size_t Terminal::print(const std::string &message, bool bold){
+  flush_pending_output(); // Keep earlier process output before message
+  follow_output();
+  return insert(message, bold);
+}
+
+Glib::ustring Terminal::get_printable(const std::string &message) {
 #ifdef _WIN32
   //Remove color codes
   auto message_no_color=message; //copy here since operations on Glib::ustring is too slow
@@ -267,6 +483,14 @@ size_t Terminal::print(const std::string &message, bool bold){
     next_char_iter++;
     umessage.replace(iter, next_char_iter, "?");
   }
+  return umessage;
+}
+
+size_t Terminal::insert(const std::string &message, bool bold) {
+  auto umessage=get_printable(message);
+  history.append(umessage.raw(), bold);
+  if(!following_output)
+    return history.last_line();
   
   auto start_mark=get_buffer()->create_mark(get_buffer()->get_iter_at_line(get_buffer()->end().get_line()));
   if(bold)
@@ -289,24 +513,122 @@ size_t Terminal::print(const std::string &message, bool bold){
 }
 
 void Terminal::async_print(const std::string &message, bool bold) {
-  dispatcher.post([message, bold] {
-    Terminal::get().print(message, bold);
-  });
+  std::unique_lock<std::mutex> lock(pending_output_mutex);
+  add_pending_output(message, bold);
+}
+
+void Terminal::async_print_process_output(const std::string &message, bool bold) {
+  std::unique_lock<std::mutex> lock(pending_output_mutex);
+  auto now=std::chrono::steady_clock::now();
+  if(now-output_interval_start>=std::chrono::seconds(1)) {
+    output_interval_start=now;
+    output_interval_bytes=0;
+    add_omitted_output_notice();
+  }
+  
+  auto rate_limit=Config::get().terminal.output_rate_limit;
+  if(rate_limit>0 && output_interval_bytes>=static_cast<size_t>(rate_limit)) {
+    if(omitted_output_bytes==0) {
+      // Show the notice when the interval ends, also if no more output arrives
+      auto delay=std::chrono::duration_cast<std::chrono::milliseconds>(output_interval_start+std::chrono::seconds(1)-now).count()+1;
+      dispatcher.post([this, delay] {
+        Glib::signal_timeout().connect([this] {
+          {
+            std::unique_lock<std::mutex> lock(pending_output_mutex);
+            if(std::chrono::steady_clock::now()-output_interval_start<std::chrono::seconds(1))
+              return false; // A new interval has started, and has added the notice
+            add_omitted_output_notice();
+          }
+          flush_pending_output();
+          return false;
+        }, delay);
+      });
+    }
+    omitted_output_bytes+=message.size();
+    return;
+  }
+  output_interval_bytes+=message.size();
+  add_pending_output(message, bold);
+}
+
+void Terminal::add_pending_output(const std::string &message, bool bold) {
+  if(!pending_output.empty() && pending_output.back().second==bold)
+    pending_output.back().first+=message;
+  else
+    pending_output.emplace_back(message, bold);
+  
+  if(!pending_output_flush_posted) {
+    pending_output_flush_posted=true;
+    dispatcher.post([this] {
+      Glib::signal_timeout().connect([this] {
+        flush_pending_output();
+        return false;
+      }, 16);
+    });
+  }
+}
+
+void Terminal::add_omitted_output_notice() {
+  if(omitted_output_bytes==0)
+    return;
+  add_pending_output("\n[" + std::to_string(omitted_output_bytes) + " bytes of output omitted]\n", true);
+  omitted_output_bytes=0;
+}
+
+void Terminal::flush_pending_output() {
+  std::list<std::pair<std::string, bool>> output;
+  {
+    std::unique_lock<std::mutex> lock(pending_output_mutex);
+    output.swap(pending_output);
+    pending_output_flush_posted=false;
+  }
+  if(output.empty())
+    return;
+  
+  if(!following_output) {
+    for(auto &chunk: output)
+      insert(chunk.first, chunk.second);
+    return;
+  }
+  
+  // Skip lines that would be removed from the history right after being inserted.
+  // The newline ending the last skipped line is kept to terminate the current last line.
+  auto history_size=static_cast<size_t>(std::max(Config::get().terminal.history_size, 0));
+  size_t newlines=0;
+  for(auto it=output.rbegin();it!=output.rend();++it) {
+    auto &text=it->first;
+    size_t pos=text.size();
+    for(;pos>0;--pos) {
+      if(text[pos-1]=='\n' && ++newlines>history_size)
+        break;
+    }
+    if(pos>0) {
+      auto chunk=std::next(it).base();
+      size_t skipped_lines=std::count(text.begin(), text.begin()+(pos-1), '\n');
+      // The skipped lines are only added to the history
+      for(auto skipped=output.begin();skipped!=chunk;++skipped) {
+        skipped_lines+=std::count(skipped->first.begin(), skipped->first.end(), '\n');
+        history.append(get_printable(skipped->first).raw(), skipped->second);
+      }
+      history.append(get_printable(text.substr(0, pos-1)).raw(), it->second);
+      text.erase(0, pos-1);
+      output.erase(output.begin(), chunk);
+      deleted_lines+=skipped_lines;
+      break;
+    }
+  }
+  
+  for(auto &chunk: output)
+    insert(chunk.first, chunk.second);
 }
 
 void Terminal::async_print(size_t line_nr, const std::string &message) {
   dispatcher.post([this, line_nr, message] {
-    if(line_nr<deleted_lines)
+    auto umessage=get_printable(message);
+    history.append_to_line(line_nr, umessage.raw());
+    if(line_nr<deleted_lines || line_nr-deleted_lines>=static_cast<size_t>(get_buffer()->get_line_count()))
       return;
     
-    Glib::ustring umessage=message;
-    Glib::ustring::iterator iter;
-    while(!umessage.validate(iter)) {
-      auto next_char_iter=iter;
-      next_char_iter++;
-      umessage.replace(iter, next_char_iter, "?");
-    }
-    
     auto end_line_iter=get_buffer()->get_iter_at_line(static_cast<int>(line_nr-deleted_lines));
     while(!end_line_iter.ends_line() && end_line_iter.forward_char()) {}
     get_buffer()->insert(end_line_iter, umessage);
@@ -316,6 +638,8 @@ void Terminal::async_print(size_t line_nr, const std::string &message) {
 void Terminal::configure() {
   link_tag->property_foreground_rgba()=get_style_context()->get_color(Gtk::StateFlags::STATE_FLAG_LINK);
   
+  history.max_lines=static_cast<size_t>(std::max(Config::get().terminal.history_size, 1))+static_cast<size_t>(std::max(Config::get().terminal.scrollback_size, 0));
+  
   if(Config::get().terminal.font.size()>0) {
     override_font(Pango::FontDescription(Config::get().terminal.font));
   }
@@ -333,7 +657,94 @@ void Terminal::configure() {
 }
 
 void Terminal::clear() {
+  {
+    std::unique_lock<std::mutex> lock(pending_output_mutex);
+    pending_output.clear();
+    omitted_output_bytes=0;
+  }
+  history.clear();
+  following_output=true;
   get_buffer()->set_text("");
+  deleted_lines=history.last_line();
+}
+
+void Terminal::show_earlier_lines() {
+  if(deleted_lines<=history.first_line())
+    return;
+  showing_history=true;
+  auto history_size=static_cast<size_t>(std::max(Config::get().terminal.history_size, 1));
+  auto count=std::min(deleted_lines-history.first_line(), std::max(history_size/2, static_cast<size_t>(1)));
+  
+  auto first_line_mark=get_buffer()->create_mark(get_buffer()->begin());
+  auto lines=history.get_lines(deleted_lines-count, deleted_lines-1);
+  lines.back().first+='\n';
+  insert_lines(get_buffer()->begin(), lines);
+  deleted_lines-=count;
+  
+  // Keep at most history_size complete lines, where the last line might still be continued in the history
+  auto keep_lines=std::min(static_cast<size_t>(get_buffer()->get_line_count()-1), history_size);
+  auto keep_end=get_buffer()->get_iter_at_line(static_cast<int>(keep_lines-1));
+  if(!keep_end.ends_line())
+    keep_end.forward_to_line_end();
+  get_buffer()->erase(keep_end, get_buffer()->end());
+  following_output=false;
+  
+  scroll_to(first_line_mark, 0.0, 0.0, 0.0);
+  get_buffer()->delete_mark(first_line_mark);
+  showing_history=false;
+}
+
+void Terminal::show_later_lines() {
+  auto last_line=deleted_lines+static_cast<size_t>(get_buffer()->get_line_count()-1);
+  if(last_line>=history.last_line()) {
+    following_output=true;
+    return;
+  }
+  showing_history=true;
+  auto history_size=static_cast<size_t>(std::max(Config::get().terminal.history_size, 1));
+  auto count=std::min(history.last_line()-last_line, std::max(history_size/2, static_cast<size_t>(1)));
+  
+  auto last_line_mark=get_buffer()->create_mark(get_buffer()->get_iter_at_line(get_buffer()->end().get_line()));
+  auto lines=history.get_lines(last_line+1, last_line+count);
+  lines.front().first.insert(0, "\n");
+  insert_lines(get_buffer()->end(), lines);
+  following_output=last_line+count==history.last_line();
+  
+  auto line_count=static_cast<size_t>(get_buffer()->get_line_count());
+  if(line_count>history_size) {
+    get_buffer()->erase(get_buffer()->begin(), get_buffer()->get_iter_at_line(static_cast<int>(line_count-history_size)));
+    deleted_lines+=line_count-history_size;
+  }
+  
+  scroll_to(last_line_mark, 0.0, 0.0, 1.0);
+  get_buffer()->delete_mark(last_line_mark);
+  showing_history=false;
+}
+
+void Terminal::follow_output() {
+  if(following_output)
+    return;
+  auto history_size=static_cast<size_t>(std::max(Config::get().terminal.history_size, 1));
+  auto last_line=history.last_line();
+  deleted_lines=std::max(last_line>=history_size?last_line-history_size+1:0, history.first_line());
+  showing_history=true;
+  get_buffer()->set_text("");
+  insert_lines(get_buffer()->begin(), history.get_lines(deleted_lines, last_line));
+  following_output=true;
+  showing_history=false;
+}
+
+void Terminal::insert_lines(Gtk::TextIter iter, const std::list<std::pair<std::string, bool>> &lines) {
+  auto start_mark=get_buffer()->create_mark(iter);
+  for(auto &line: lines) {
+    if(line.second)
+      iter=get_buffer()->insert_with_tag(iter, line.first, bold_tag);
+    else
+      iter=get_buffer()->insert(iter, line.first);
+  }
+  auto start_iter=start_mark->get_iter();
+  get_buffer()->delete_mark(start_mark);
+  apply_link_tags(start_iter, iter);
 }
 
 bool Terminal::on_button_press_event(GdkEventButton* button_event) {
@@ -6,11 +6,50 @@
 #include <iostream>
 #include "process.hpp"
 #include "dispatcher.h"
+#include "build_diagnostics.h"
 #include <tuple>
+#include <deque>
+#include <list>
+#include <unordered_map>
+#include <chrono>
 
 class Terminal : public Gtk::TextView {
   Terminal();
 public:
+  /// Lines of output stored compactly in chunks of lines, where the oldest chunks are removed when there are more than max_lines lines
+  class History {
+  public:
+    static const size_t chunk_size=4096;
+    size_t max_lines=-1;
+    
+    /// Appends message, where the first line of message continues the last line
+    void append(const std::string &message, bool bold);
+    /// Appends message, which must not contain newlines, to the end of the given line
+    void append_to_line(size_t line_nr, const std::string &message);
+    /// Removes all lines, while the line numbers continue from the last line
+    void clear();
+    
+    /// Number of the first stored line, counting from the first line appended
+    size_t first_line() const { return first_line_nr; }
+    /// Number of the last line, which is not terminated by a newline
+    size_t last_line() const { return newline_count; }
+    /// Returns the lines from first to last, inclusive, joined by newlines and split where the bold state changes
+    std::list<std::pair<std::string, bool>> get_lines(size_t first, size_t last) const;
+    
+  private:
+    class Chunk {
+    public:
+      /// The lines without newlines
+      std::string text;
+      std::vector<size_t> line_ends;
+      /// Lines containing bold output
+      std::vector<bool> bold_lines;
+    };
+    std::deque<Chunk> chunks;
+    size_t first_line_nr=0;
+    size_t newline_count=0;
+  };
+  
   static Terminal &get() {
     static Terminal singleton;
     return singleton;
@@ -18,17 +57,26 @@ public:
   
   int process(const std::string &command, const boost::filesystem::path &path="", bool use_pipes=true);
   int process(std::istream &stdin_stream, std::ostream &stdout_stream, const std::string &command, const boost::filesystem::path &path="", std::ostream *stderr_stream=nullptr);
-  void async_process(const std::string &command, const boost::filesystem::path &path="", const std::function<void(int exit_status)> &callback=nullptr, bool quiet=false);
+  /// Returns an id that can be used to kill the process with kill_async_process().
+  /// If parse_diagnostics is true, the output is parsed for compiler diagnostics and build progress, which are added to BuildDiagnostics.
+  size_t async_process(const std::string &command, const boost::filesystem::path &path="", const std::function<void(int exit_status)> &callback=nullptr, bool quiet=false, bool parse_diagnostics=false);
+  /// Kills the process started by async_process() with the given id, if it has not already exited
+  void kill_async_process(size_t id, bool force=false);
   void kill_last_async_process(bool force=false);
   void kill_async_processes(bool force=false);
   
   size_t print(const std::string &message, bool bold=false);
+  /// Queues message for insertion. Queued output is coalesced and inserted at most once per frame.
   void async_print(const std::string &message, bool bold=false);
   void async_print(size_t line_nr, const std::string &message);
   
   void configure();
   
+  /// Removes all output, including output queued by async_print() that has not been inserted yet
   void clear();
+  
+  /// False while scrolled back in history, where new output is kept in the history until the end is scrolled to
+  bool is_following_output() const { return following_output; }
 protected:
   bool on_motion_notify_event (GdkEventMotion* motion_event) override;
   bool on_button_press_event(GdkEventButton* button_event) override;
@@ -39,12 +87,53 @@ private:
   Glib::RefPtr<Gtk::TextTag> link_tag;
   Glib::RefPtr<Gdk::Cursor> link_mouse_cursor;
   Glib::RefPtr<Gdk::Cursor> default_mouse_cursor;
+  /// Line number of the first line shown
   size_t deleted_lines=0;
   
+  /// All output, including the lines shown
+  History history;
+  bool following_output=true;
+  bool showing_history=false;
+  sigc::connection vadjustment_value_changed_connection;
+  /// Shows earlier lines from the history, and stops following output
+  void show_earlier_lines();
+  /// Shows later lines from the history, and follows output again when the last line is shown
+  void show_later_lines();
+  /// Shows the last lines of the history, and follows output
+  void follow_output();
+  void insert_lines(Gtk::TextIter iter, const std::list<std::pair<std::string, bool>> &lines);
+  
+  /// Output waiting to be inserted, where consecutive chunks with the same bold state are joined
+  std::list<std::pair<std::string, bool>> pending_output;
+  std::mutex pending_output_mutex;
+  bool pending_output_flush_posted=false;
+  std::chrono::steady_clock::time_point output_interval_start;
+  size_t output_interval_bytes=0;
+  size_t omitted_output_bytes=0;
+  /// Like async_print(), but output beyond Config::get().terminal.output_rate_limit bytes per second is omitted.
+  /// Used for the output of async_process(), so that messages from juCi++ itself are never omitted.
+  void async_print_process_output(const std::string &message, bool bold=false);
+  /// pending_output_mutex must be locked
+  void add_pending_output(const std::string &message, bool bold);
+  /// pending_output_mutex must be locked. Adds a notice about omitted output, if any.
+  void add_omitted_output_notice();
+  /// Inserts the pending output, and must be called from the main thread
+  void flush_pending_output();
+  size_t insert(const std::string &message, bool bold);
+  /// Replaces invalid UTF-8, and removes color codes on Windows
+  static Glib::ustring get_printable(const std::string &message);
+  
   std::tuple<size_t, size_t, std::string, std::string, std::string> find_link(const std::string &line);
   void apply_link_tags(const Gtk::TextIter &start_iter, const Gtk::TextIter &end_iter);
+  /// Adds diagnostics parsed from process output to BuildDiagnostics in the main thread
+  void async_add_build_diagnostics(std::vector<BuildDiagnostics::Diagnostic> &&diagnostics);
 
   std::vector<std::shared_ptr<TinyProcessLib::Process>> processes;
   std::mutex processes_mutex;
+  size_t last_process_id=0;
+  /// Running processes by async_process() id
+  std::unordered_map<size_t, std::shared_ptr<TinyProcessLib::Process>> processes_by_id;
+  /// Processes that have not been started yet, and whether they were killed before they started
+  std::unordered_map<size_t, bool> starting_processes;
   Glib::ustring stdin_buffer;
 };
@@ -10,6 +10,8 @@
 #include "info.h"
 #include "selection_dialog.h"
 #include "terminal.h"
+#include "source_language_protocol.h"
+#include "build_diagnostics.h"
 
 Window::Window() {
   Gsv::init();
@@ -94,6 +96,26 @@ Window::Window() {
     }
   };
   
+  BuildDiagnostics::get().on_add=[](const BuildDiagnostics::Diagnostic &diagnostic) {
+    for(auto view: Notebook::get().get_views())
+      BuildDiagnostics::get().add_marker(view, diagnostic);
+  };
+  BuildDiagnostics::get().on_clear=[]() {
+    for(auto view: Notebook::get().get_views()) {
+      if(!view->goto_next_diagnostic)
+        view->clear_diagnostic_tooltips();
+    }
+  };
+  BuildDiagnostics::get().on_progress=[]() {
+    auto progress=BuildDiagnostics::get().progress;
+    if(Project::compiling && progress>=0.0) {
+      Project::build_progress_bar().set_fraction(progress);
+      Project::build_progress_bar().show();
+    }
+    else
+      Project::build_progress_bar().hide();
+  };
+  
   signal_focus_out_event().connect([](GdkEventFocus *event) {
     if(auto view=Notebook::get().get_current_view()) {
       view->hide_tooltips();
@@ -511,6 +533,96 @@ void Window::set_menu_actions() {
     if(auto view=Notebook::get().get_current_view())
       view->git_goto_next_diff();
   });
+  menu.add_action("source_git_changed_files", []() {
+    auto view=Notebook::get().get_current_view();
+    boost::filesystem::path search_path;
+    if(view)
+      search_path=view->file_path.parent_path();
+    else if(!Directories::get().path.empty())
+      search_path=Directories::get().path;
+    else {
+      Info::get().print("No file or directory is open");
+      return;
+    }
+    
+    std::shared_ptr<Git::Repository> repository;
+    try {
+      repository=Git::get_repository(search_path);
+    }
+    catch(const std::exception &e) {
+      Terminal::get().print(std::string("Error (git): ")+e.what()+'\n', true);
+      return;
+    }
+    if(!repository) {
+      Info::get().print("No repository found");
+      return;
+    }
+    
+    // The status scan of a large repository can take a while, and is therefore run in a separate thread
+    static Dispatcher dispatcher;
+    std::thread status_thread([repository] {
+      std::shared_ptr<const Git::Repository::Status> status;
+      std::string error;
+      try {
+        status=repository->get_status();
+      }
+      catch(const std::exception &e) {
+        error=e.what();
+      }
+      dispatcher.post([repository, status=std::move(status), error=std::move(error)] {
+        if(!status) {
+          Terminal::get().print("Error (git): "+error+'\n', true);
+          return;
+        }
+        
+        if(status->modified_count+status->new_count+status->untracked_count==0) {
+          Info::get().print("No changed files found in repository");
+          return;
+        }
+        
+        auto view=Notebook::get().get_current_view();
+        if(view) {
+          auto dialog_iter=view->get_iter_for_dialog();
+          SelectionDialog::create(view, view->get_buffer()->create_mark(dialog_iter), true, true);
+        }
+        else
+          SelectionDialog::create(true, true);
+        
+        std::vector<boost::filesystem::path> paths;
+        auto work_path=repository->get_work_path();
+        status->for_each([&paths, &work_path](const std::string &path, Git::Repository::STATUS file_status) {
+          std::string prefix;
+          if(file_status==Git::Repository::STATUS::MODIFIED)
+            prefix="M ";
+          else if(file_status==Git::Repository::STATUS::NEW)
+            prefix="A ";
+          else
+            prefix="? ";
+          paths.emplace_back(work_path/path);
+          SelectionDialog::get()->add_row(prefix+Glib::Markup::escape_text(path));
+        });
+        Info::get().print(std::to_string(status->modified_count)+" modified, "+std::to_string(status->new_count)+" added and "+
+                          std::to_string(status->untracked_count)+" untracked files");
+        
+        SelectionDialog::get()->on_select=[paths=std::move(paths)](unsigned int index, const std::string &text, bool hide_window) {
+          if(index>=paths.size())
+            return;
+          Notebook::get().open(paths[index]);
+          if (auto view=Notebook::get().get_current_view())
+            view->hide_tooltips();
+        };
+        
+        if(view)
+          view->hide_tooltips();
+        SelectionDialog::get()->show();
+      });
+    });
+    status_thread.detach();
+  });
+  menu.add_action("source_git_toggle_blame", []() {
+    if(auto view=Notebook::get().get_current_view())
+      view->git_toggle_blame();
+  });
   menu.add_action("source_git_show_diff", []() {
     if(auto view=Notebook::get().get_current_view()) {
       auto diff_details=view->git_get_diff_details();
@@ -1036,8 +1148,9 @@ void Window::set_menu_actions() {
     EntryBox::get().show();
   });
   menu.add_action("project_compile_and_run", []() {
-    if(Project::compiling || Project::debugging) {
-      Info::get().print("Compile or debug in progress");
+    // A build in progress is restarted
+    if(Project::debugging) {
+      Info::get().print("Debug in progress");
       return;
     }
     
@@ -1049,8 +1162,9 @@ void Window::set_menu_actions() {
     Project::current->compile_and_run();
   });
   menu.add_action("project_compile", []() {
-    if(Project::compiling || Project::debugging) {
-      Info::get().print("Compile or debug in progress");
+    // A build in progress is restarted
+    if(Project::debugging) {
+      Info::get().print("Debug in progress");
       return;
     }
             
@@ -1061,6 +1175,76 @@ void Window::set_menu_actions() {
     
     Project::current->compile();
   });
+  menu.add_action("project_compile_file", []() {
+    if(!Notebook::get().get_current_view())
+      return;
+    
+    Project::current=Project::create();
+    
+    if(Config::get().project.save_on_compile_or_run)
+      Project::save_files(Project::current->build->project_path);
+    
+    Project::current->compile_file(false);
+  });
+  menu.add_action("project_check_file_syntax", []() {
+    if(!Notebook::get().get_current_view())
+      return;
+    
+    Project::current=Project::create();
+    
+    if(Config::get().project.save_on_compile_or_run)
+      Project::save_files(Project::current->build->project_path);
+    
+    Project::current->compile_file(true);
+  });
+  menu.add_action("project_cancel_build", []() {
+    Project::cancel_build();
+  });
+  menu.add_action("project_show_build_diagnostics", []() {
+    auto &build_diagnostics=BuildDiagnostics::get();
+    if(build_diagnostics.diagnostics.empty()) {
+      Info::get().print("No build diagnostics found");
+      return;
+    }
+    
+    auto view=Notebook::get().get_current_view();
+    if(view) {
+      auto dialog_iter=view->get_iter_for_dialog();
+      SelectionDialog::create(view, view->get_buffer()->create_mark(dialog_iter), true, true);
+    }
+    else
+      SelectionDialog::create(true, true);
+    
+    for(auto &diagnostic: build_diagnostics.diagnostics) {
+      auto row="<b>"+diagnostic.severity_string()+"</b> "+
+               Glib::Markup::escape_text(filesystem::get_short_path(diagnostic.path).string()+':'+std::to_string(diagnostic.line)+':'+
+                                         std::to_string(diagnostic.index)+": "+diagnostic.message);
+      for(auto &include: diagnostic.include_chain)
+        row+=" <i>(included from "+Glib::Markup::escape_text(filesystem::get_short_path(include.first).string()+':'+std::to_string(include.second))+")</i>";
+      SelectionDialog::get()->add_row(row);
+    }
+    Info::get().print(std::to_string(build_diagnostics.error_count)+" errors and "+std::to_string(build_diagnostics.warning_count)+" warnings");
+    
+    SelectionDialog::get()->on_select=[](unsigned int index, const std::string &text, bool hide_window) {
+      auto &diagnostics=BuildDiagnostics::get().diagnostics;
+      if(index>=diagnostics.size())
+        return;
+      auto diagnostic=diagnostics[index];
+      if(!boost::filesystem::is_regular_file(diagnostic.path)) {
+        Info::get().print("File not found: "+filesystem::get_short_path(diagnostic.path).string());
+        return;
+      }
+      Notebook::get().open(diagnostic.path);
+      if(auto view=Notebook::get().get_current_view()) {
+        view->place_cursor_at_line_index(diagnostic.line-1, diagnostic.index-1);
+        view->scroll_to_cursor_delayed(view, true, true);
+      }
+    };
+    
+    if(view)
+      view->hide_tooltips();
+    SelectionDialog::get()->show();
+  });
   menu.add_action("project_recreate_build", []() {
     if(Project::compiling || Project::debugging) {
       Info::get().print("Compile or debug in progress");
@@ -1264,6 +1448,8 @@ void Window::set_menu_actions() {
     menu.actions["source_spellcheck_next_error"]->set_enabled(view);
     menu.actions["source_git_next_diff"]->set_enabled(view);
     menu.actions["source_git_show_diff"]->set_enabled(view);
+    menu.actions["source_git_toggle_blame"]->set_enabled(view);
+    menu.actions["source_git_changed_files"]->set_enabled(view || !Directories::get().path.empty());
     menu.actions["source_indentation_set_buffer_tab"]->set_enabled(view);
     menu.actions["source_goto_line"]->set_enabled(view);
     menu.actions["source_center_cursor"]->set_enabled(view);
@@ -1282,6 +1468,8 @@ void Window::set_menu_actions() {
     menu.actions["source_implement_method"]->set_enabled(view && view->get_method);
     menu.actions["source_goto_next_diagnostic"]->set_enabled(view && view->goto_next_diagnostic);
     menu.actions["source_apply_fix_its"]->set_enabled(view && view->get_fix_its);
+    menu.actions["project_compile_file"]->set_enabled(view);
+    menu.actions["project_check_file_syntax"]->set_enabled(view);
 #ifdef JUCI_ENABLE_DEBUG
     Project::debug_activate_menu_items();
 #endif
@@ -1317,6 +1505,9 @@ void Window::add_widgets() {
   status_hbox->pack_start(*Gtk::manage(new Gtk::Box()));
   auto status_right_hbox=Gtk::manage(new Gtk::Box());
   status_right_hbox->pack_end(Notebook::get().status_state, Gtk::PACK_SHRINK);
+  Project::build_progress_bar().set_no_show_all();
+  Project::build_progress_bar().set_valign(Gtk::Align::ALIGN_CENTER);
+  status_right_hbox->pack_end(Project::build_progress_bar(), Gtk::PACK_SHRINK);
   auto status_right_overlay=Gtk::manage(new Gtk::Overlay());
   status_right_overlay->add(*status_right_hbox);
   status_right_overlay->add_overlay(Notebook::get().status_diagnostics);
@@ -1355,6 +1546,8 @@ void Window::add_widgets() {
   
   //Scroll to end of terminal whenever info is printed
   Terminal::get().signal_size_allocate().connect([terminal_scrolled_window](Gtk::Allocation& allocation){
+    if(!Terminal::get().is_following_output())
+      return;
     auto adjustment=terminal_scrolled_window->get_vadjustment();
     adjustment->set_value(adjustment->get_upper()-adjustment->get_page_size());
     Terminal::get().queue_draw();
@@ -1418,6 +1611,7 @@ bool Window::on_delete_event(GdkEventAny *event) {
     if(!Notebook::get().close(c))
       return true;
   }
+  LanguageProtocol::Client::shutdown_idle(true);
   Terminal::get().kill_async_processes();
 #ifdef JUCI_ENABLE_DEBUG
   if(Project::current)
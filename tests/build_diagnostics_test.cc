@@ -0,0 +1,83 @@
+#include "build_diagnostics.h"
+#include <glib.h>
+
+int main() {
+  {
+    BuildDiagnostics::Parser parser("/build");
+    std::string output("[1/2] Building CXX object main.cc.o\nIn file included from ../src/main.cc:1:\n../src/a.h:3:5: err");
+    auto diagnostics=parser.parse(output.data(), output.size());
+    g_assert(diagnostics.empty());
+    g_assert(parser.progress==0.5);
+    output="or: use of undeclared identifier 'b'\n";
+    diagnostics=parser.parse(output.data(), output.size());
+    g_assert_cmpuint(diagnostics.size(), ==, 1);
+    g_assert(diagnostics[0].path=="/src/a.h");
+    g_assert_cmpint(diagnostics[0].line, ==, 3);
+    g_assert_cmpint(diagnostics[0].index, ==, 5);
+    g_assert(diagnostics[0].severity==BuildDiagnostics::Diagnostic::Severity::ERROR);
+    g_assert_cmpstr(diagnostics[0].message.c_str(), ==, "use of undeclared identifier 'b'");
+    g_assert_cmpuint(diagnostics[0].include_chain.size(), ==, 1);
+    g_assert(diagnostics[0].include_chain[0].first=="/src/main.cc");
+    g_assert_cmpint(diagnostics[0].include_chain[0].second, ==, 1);
+  }
+  {
+    BuildDiagnostics::Parser parser("/build");
+    std::string output("In file included from /src/b.h:2,\n"
+                       "                 from /src/main.cc:1:\n"
+                       "/src/c.h: In function 'int f()':\n"
+                       "/src/c.h:7:10: warning: unused variable 'a' [-Wunused-variable]\n"
+                       "/src/c.h:8: note: declared here\n"
+                       "/src/main.cc:4:1: \x1b[01;31merror: \x1b[0mexpected ';'\r\n"
+                       "/src/main.cc:5:1: fatal error: x.h: No such file or directory");
+    auto diagnostics=parser.parse(output.data(), output.size());
+    g_assert_cmpuint(diagnostics.size(), ==, 3);
+    g_assert(diagnostics[0].severity==BuildDiagnostics::Diagnostic::Severity::WARNING);
+    g_assert_cmpuint(diagnostics[0].include_chain.size(), ==, 2);
+    g_assert(diagnostics[0].include_chain[0].first=="/src/b.h");
+    g_assert(diagnostics[0].include_chain[1].first=="/src/main.cc");
+    g_assert(diagnostics[1].severity==BuildDiagnostics::Diagnostic::Severity::NOTE);
+    g_assert_cmpint(diagnostics[1].index, ==, 1);
+    g_assert(diagnostics[1].include_chain.empty());
+    g_assert(diagnostics[2].severity==BuildDiagnostics::Diagnostic::Severity::ERROR);
+    g_assert_cmpstr(diagnostics[2].message.c_str(), ==, "expected ';'");
+    
+    diagnostics=parser.finish();
+    g_assert_cmpuint(diagnostics.size(), ==, 1);
+    g_assert_cmpstr(diagnostics[0].message.c_str(), ==, "x.h: No such file or directory");
+  }
+  {
+    BuildDiagnostics::Parser parser("/build");
+    g_assert(parser.progress<0.0);
+    std::string output("[ 25%] Building CXX object CMakeFiles/a.dir/main.cc.o\n"
+                       "[100%] Built target a\n"
+                       "[a/b] Not progress\n");
+    parser.parse(output.data(), output.size());
+    g_assert(parser.progress==1.0);
+  }
+  {
+    auto &build_diagnostics=BuildDiagnostics::get();
+    BuildDiagnostics::Parser parser("/build");
+    std::string output("/src/main.cc:4:1: error: expected ';'\n"
+                       "/src/main.cc:4:1: error: expected ';'\n"
+                       "/src/main.cc:6:1: warning: unused\n");
+    build_diagnostics.add(parser.parse(output.data(), output.size()));
+    g_assert_cmpuint(build_diagnostics.diagnostics.size(), ==, 2);
+    g_assert_cmpuint(build_diagnostics.error_count, ==, 1);
+    g_assert_cmpuint(build_diagnostics.warning_count, ==, 1);
+    
+    output="/src/b.cc:1:1: warning: unused\n";
+    build_diagnostics.add(parser.parse(output.data(), output.size()));
+    build_diagnostics.begin_file_check("/src/main.cc");
+    g_assert_cmpuint(build_diagnostics.diagnostics.size(), ==, 1);
+    g_assert(build_diagnostics.diagnostics[0].path=="/src/b.cc");
+    g_assert_cmpuint(build_diagnostics.error_count, ==, 0);
+    g_assert_cmpuint(build_diagnostics.warning_count, ==, 1);
+    g_assert_cmpuint(build_diagnostics.checked_files.count("/src/main.cc"), ==, 1);
+    
+    build_diagnostics.set_progress(0.25);
+    build_diagnostics.clear();
+    g_assert(build_diagnostics.diagnostics.empty());
+    g_assert(build_diagnostics.progress<0.0);
+    g_assert(build_diagnostics.checked_files.empty());
+  }
+}
@@ -15,6 +15,8 @@ int main() {
     
     {
       CMake cmake(project_path);
+      // The executables below are found through the File API reply if supported by the installed CMake
+      CMake::create_file_api_query(project_path/"build");
       TinyProcessLib::Process process("cmake -DCMAKE_EXPORT_COMPILE_COMMANDS=ON ..", (project_path/"build").string(), [](const char *bytes, size_t n) {});
       g_assert(process.get_exit_status()==0);
       
@@ -27,6 +29,8 @@ int main() {
       g_assert(cmake.get_executable(project_path/"build", project_path/"src"/"cmake.cc")==project_path/"build"/"src"/"juci");
       g_assert(cmake.get_executable(project_path/"build", project_path/"src"/"juci.cc")==project_path/"build"/"src"/"juci");
       g_assert(cmake.get_executable(project_path/"build", project_path/"src"/"non_existing_file.cc")==project_path/"build"/"src"/"juci");
+      if(auto code_model=CMake::get_code_model(project_path/"build"))
+        g_assert(code_model->target_names_by_executable.at((project_path/"build"/"src"/"juci").string())=="juci");
     }
     {
       CMake cmake(tests_path);
@@ -47,6 +51,14 @@ int main() {
     build=Project::Build::create(tests_path/"stubs");
     g_assert(dynamic_cast<Project::CMakeBuild*>(build.get()));
     g_assert(build->project_path==project_path);
+    g_assert(Project::Build::cache.count((tests_path/"stubs").string())==1);
+    
+    auto cached_build=Project::Build::create(tests_path/"stubs");
+    g_assert(dynamic_cast<Project::CMakeBuild*>(cached_build.get()));
+    g_assert(cached_build.get()!=build.get());
+    g_assert(cached_build->project_path==project_path);
+    Project::Build::clear_cache();
+    g_assert(Project::Build::cache.empty());
     
     Config::get().project.default_build_path="./build";
     g_assert(build->get_default_path()==project_path/"build");
@@ -60,6 +72,12 @@ int main() {
     
     Config::get().project.default_build_path="../build_<project_directory_name>";
     g_assert(build->get_default_path()==project_path.parent_path()/("build_"+project_path_filename.string()));
+    
+    Config::get().project.cmake.compile_command="cmake --build .";
+    Config::get().project.build_jobs=2;
+    g_assert(build->get_compile_command()=="cmake --build . -- -j2");
+    Config::get().project.cmake.compile_command="make";
+    g_assert(build->get_compile_command()=="make");
   }
   {
     auto project_path=tests_path/"source_clang_test_files";
@@ -21,6 +21,12 @@ int main() {
     g_assert_cmpuint(parameter_values.size(), ==, 1);
     g_assert_cmpstr(parameter_values.at(0).c_str(), ==, "hello_lib@sta/main.cpp.o");
     
+    g_assert_cmpstr(compile_commands.commands.at(0).get_file_command(true).c_str(), ==,
+                    "c++ -Ihello_lib@sta -I.. -I. -Wall -Winvalid-pch -Wnon-virtual-dtor -std=c++11 -Wall -Wextra -O0 -g ../main.cpp -fsyntax-only");
+    g_assert_cmpstr(compile_commands.commands.at(0).get_file_command(false).c_str(), ==,
+                    "c++ -Ihello_lib@sta -I.. -I. -Wall -Winvalid-pch -Wnon-virtual-dtor -std=c++11 -Wall -Wextra -O0 -g -MMD -MQ hello_lib@sta/main.cpp.o "
+                    "-MF hello_lib@sta/main.cpp.o.d -o hello_lib@sta/main.cpp.o -c ../main.cpp");
+    
     g_assert(boost::filesystem::canonical(compile_commands.commands.at(0).file) == tests_path/"meson_test_files"/"main.cpp");
   }
   
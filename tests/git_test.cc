@@ -2,6 +2,8 @@
 #include <gtkmm.h>
 #include "git.h"
 #include <boost/filesystem.hpp>
+#include <fstream>
+#include <sstream>
 
 int main() {
   auto app=Gtk::Application::create();
@@ -14,15 +16,49 @@ int main() {
     auto repository=Git::get_repository(tests_path);
     
     g_assert(repository->get_path()==git_path);
+    g_assert(Git::get_repository(tests_path)==repository);
+    g_assert(Git::get_repository(tests_path/"stubs")==repository);
     g_assert(repository->get_work_path()==jucipp_path);
     
     auto status=repository->get_status();
     
+    auto tests_status=repository->get_status({tests_path});
+    status->for_each([&tests_status, &jucipp_path](const std::string &path, Git::Repository::STATUS file_status) {
+      if(file_status==Git::Repository::STATUS::MODIFIED)
+        g_assert(tests_status->is_modified(jucipp_path/path));
+      else
+        g_assert(tests_status->is_added(jucipp_path/path));
+    });
+    repository->clear_saved_status(tests_path);
+    tests_status=repository->get_status({tests_path});
+    g_assert(tests_status->modified_count==status->modified_count);
+    g_assert(tests_status->new_count==status->new_count);
+    g_assert(tests_status->untracked_count==status->untracked_count);
+    g_assert(repository->get_status({tests_path})==tests_status);
+    
     auto diff=repository->get_diff((boost::filesystem::path("tests")/"git_test.cc"));
-    auto lines=diff.get_lines("#include added\n#include <glib.h>\n#include modified\n#include \"git.h\"\n");
-    g_assert_cmpuint(lines.added.size(), ==, 1);
-    g_assert_cmpuint(lines.modified.size(), ==, 1);
-    g_assert_cmpuint(lines.removed.size(), ==, 1);
+    g_assert(repository->get_diff((boost::filesystem::path("tests")/"git_test.cc"))==diff);
+    g_assert(!diff->get_line_hashes().empty());
+    g_assert(diff->get_text({0, 1})=="#include <glib.h>\n");
+    std::string buffer("#include added\n#include <glib.h>\n#include modified\n#include \"git.h\"\n");
+    auto hunks=Git::Repository::Diff::get_hunks(diff->get_line_hashes(), Git::Repository::Diff::get_line_hashes(buffer.data(), buffer.size()));
+    g_assert_cmpuint(hunks.size(), ==, 3);
+    g_assert(hunks[0].old_lines.second==0 && hunks[0].new_lines==std::make_pair(0, 1));
+    g_assert(hunks[1].old_lines==std::make_pair(1, 1) && hunks[1].new_lines==std::make_pair(2, 1));
+    g_assert(diff->get_text(hunks[1].old_lines)=="#include <gtkmm.h>\n");
+    g_assert(hunks[2].old_lines.first==3 && hunks[2].new_lines.second==0);
+    
+    auto blame=repository->get_blame(boost::filesystem::path("tests")/"git_test.cc");
+    g_assert(!blame->hunks.empty());
+    g_assert(blame->get_hunk_index(0)==0);
+    g_assert(blame->get_hunk_index(-1)==-1);
+    g_assert(repository->get_blame(boost::filesystem::path("tests")/"git_test.cc")==blame);
+    std::stringstream stream;
+    blame->write(stream);
+    Git::Repository::Blame read_blame;
+    g_assert(read_blame.read(stream));
+    g_assert_cmpuint(read_blame.hunks.size(), ==, blame->hunks.size());
+    g_assert(read_blame.hunks.back().author==blame->hunks.back().author);
   }
   catch(const std::exception &e) {
     std::cerr << e.what() << std::endl;
@@ -37,6 +73,46 @@ int main() {
     return 1;
   }
   
+  {
+    auto cache_directory=boost::filesystem::temp_directory_path()/boost::filesystem::unique_path();
+    boost::filesystem::create_directories(cache_directory);
+    for(int c=0;c<5;++c) {
+      auto path=cache_directory/std::to_string(c);
+      std::ofstream(path.string()) << c;
+      boost::filesystem::last_write_time(path, 1000000+c);
+    }
+    Git::Repository::Blame::prune_cache(cache_directory, 3);
+    g_assert(!boost::filesystem::exists(cache_directory/"0") && !boost::filesystem::exists(cache_directory/"1"));
+    g_assert(boost::filesystem::exists(cache_directory/"2") && boost::filesystem::exists(cache_directory/"4"));
+    boost::filesystem::remove_all(cache_directory);
+  }
+  
+  {
+    std::map<std::string, Git::Repository::STATUS> files;
+    files.emplace("a/b.cc", Git::Repository::STATUS::MODIFIED);
+    files.emplace("a/c/d.cc", Git::Repository::STATUS::UNTRACKED);
+    files.emplace("e.cc", Git::Repository::STATUS::NEW);
+    Git::Repository::Status status;
+    status.work_path="/work";
+    for(auto &file: files)
+      status.add(file.first, file.second);
+    assert(status.is_modified("/work/a"));
+    assert(status.is_modified("/work/a/b.cc"));
+    assert(!status.is_modified("/work/a/c"));
+    assert(status.is_added("/work/a"));
+    assert(status.is_added("/work/a/c/d.cc"));
+    assert(status.is_added("/work/e.cc"));
+    assert(!status.is_added("/work/a/b.cc"));
+    assert(!status.is_added("/workspace/e.cc"));
+    assert(!status.is_modified("/work/f.cc"));
+    assert(status.modified_count==1 && status.new_count==1 && status.untracked_count==1);
+    std::vector<std::string> paths;
+    status.for_each([&paths](const std::string &path, Git::Repository::STATUS) {
+      paths.emplace_back(path);
+    });
+    assert(paths.size()==3 && paths[0]=="a/b.cc" && paths[1]=="a/c/d.cc" && paths[2]=="e.cc");
+  }
+  
   {
     std::string old_text("line 1\nline2\n\nline4\n\n");
     std::string new_text("line2\n\nline41\nline5\n\nline 5\nline 6\n");
@@ -55,4 +131,29 @@ int main() {
     assert(hunks[2].new_lines.first==6);
     assert(hunks[2].new_lines.second==2);
   }
+  
+  {
+    std::string old_text("line 1\nline2\n\nline4\n\n");
+    std::string new_text("line2\r\n\nline41\nline5\n\nline 5\nline 6\n");
+    auto old_line_hashes=Git::Repository::Diff::get_line_hashes(old_text.data(), old_text.size());
+    auto new_line_hashes=Git::Repository::Diff::get_line_hashes(new_text.data(), new_text.size());
+    assert(old_line_hashes.size()==6);
+    assert(new_line_hashes.size()==8);
+    auto hunks=Git::Repository::Diff::get_hunks(old_line_hashes, new_line_hashes);
+    assert(hunks.size()==3);
+    assert(hunks[0].old_lines.first==0);
+    assert(hunks[0].old_lines.second==1);
+    assert(hunks[0].new_lines.first==0);
+    assert(hunks[0].new_lines.second==0);
+    assert(hunks[1].old_lines.first==3);
+    assert(hunks[1].old_lines.second==1);
+    assert(hunks[1].new_lines.first==2);
+    assert(hunks[1].new_lines.second==2);
+    assert(hunks[2].old_lines.first==5);
+    assert(hunks[2].old_lines.second==0);
+    assert(hunks[2].new_lines.first==5);
+    assert(hunks[2].new_lines.second==2);
+    
+    assert(Git::Repository::Diff::get_hunks(old_line_hashes, old_line_hashes).empty());
+  }
 }
@@ -1,6 +1,7 @@
 #include "meson.h"
 #include <glib.h>
 #include "project.h"
+#include "filesystem.h"
 
 int main() {
   auto tests_path=boost::filesystem::canonical(JUCI_TESTS_PATH);
@@ -26,6 +27,39 @@ int main() {
     g_assert(meson.get_executable(meson_test_files_path/"build", meson_test_files_path/"a_subdir"/"non_existing_file.cpp")==meson_test_files_path/"build"/"a_subdir"/"hello2");
   }
   
+  {
+    auto build_path=tests_path/"tmp"/"meson_build";
+    boost::filesystem::create_directories(build_path/"meson-info");
+    auto project_path=meson_test_files_path.string();
+    filesystem::write(build_path/"meson-info"/"intro-targets.json",
+                      "[{\"name\": \"hello_lib\", \"type\": \"static library\", \"filename\": [\"libhello_lib.a\"], "
+                      "\"target_sources\": [{\"sources\": [\""+project_path+"/main.cpp\"]}]}, "
+                      "{\"name\": \"hello\", \"type\": \"executable\", \"filename\": [\"hello\"], "
+                      "\"target_sources\": [{\"sources\": [\""+project_path+"/main.cpp\"]}]}, "
+                      "{\"name\": \"hello2\", \"type\": \"executable\", \"filename\": [\"a_subdir/hello2\"], "
+                      "\"target_sources\": [{\"sources\": [\""+project_path+"/a_subdir/main.cpp\"]}]}]");
+    
+    Meson meson(meson_test_files_path);
+    auto targets=Meson::get_targets(build_path);
+    g_assert(targets);
+    g_assert(targets->executables_by_source.size()==2);
+    g_assert(Meson::get_targets(build_path)==targets);
+    g_assert(meson.get_executable(build_path, meson_test_files_path/"main.cpp")==build_path/"hello");
+    g_assert(meson.get_executable(build_path, meson_test_files_path/"a_subdir"/"main.cpp")==build_path/"a_subdir"/"hello2");
+    g_assert(meson.get_executable(build_path, meson_test_files_path/"a_subdir"/"non_existing_file.cpp")==build_path/"a_subdir"/"hello2");
+    
+    // Rewritten, most likely within the same second, with a different size
+    filesystem::write(build_path/"meson-info"/"intro-targets.json",
+                      "[{\"name\": \"hello\", \"type\": \"executable\", \"filename\": [\"hello\"], "
+                      "\"target_sources\": [{\"sources\": [\""+project_path+"/main.cpp\"]}]}]");
+    targets=Meson::get_targets(build_path);
+    g_assert(targets);
+    g_assert(targets->executables_by_source.size()==1);
+    g_assert(meson.get_executable(build_path, meson_test_files_path/"a_subdir"/"main.cpp")==build_path/"hello");
+    
+    boost::filesystem::remove_all(build_path);
+  }
+  
   auto build=Project::Build::create(meson_test_files_path);
   g_assert(dynamic_cast<Project::MesonBuild*>(build.get()));
   
@@ -1,4 +1,5 @@
 #include "terminal.h"
+#include "config.h"
 #include <glib.h>
 
 //Requires display server to work
@@ -38,4 +39,59 @@ int main() {
     assert(std::get<2>(link)=="~/test/test.cc");
     assert(std::get<3>(link)=="36");
   }
+  {
+    Config::get().terminal.history_size=3;
+    Config::get().terminal.output_rate_limit=0;
+    Terminal::get().clear();
+    Terminal::get().deleted_lines=0;
+    Terminal::get().async_print("a\nb\n");
+    Terminal::get().async_print("c\nd\ne\n");
+    assert(Terminal::get().pending_output.size()==1);
+    Terminal::get().flush_pending_output();
+    assert(Terminal::get().get_buffer()->get_text()=="d\ne\n");
+    assert(Terminal::get().print("")==5);
+    auto lines=Terminal::get().history.get_lines(0, 5);
+    assert(lines.size()==1);
+    assert(lines.front().first=="a\nb\nc\nd\ne\n");
+  }
+  {
+    Terminal::History history;
+    history.append("a\nb", false);
+    history.append("c\n", true);
+    history.append("d", false);
+    assert(history.first_line()==0);
+    assert(history.last_line()==2);
+    auto lines=history.get_lines(0, 2);
+    assert(lines.size()==3);
+    auto it=lines.begin();
+    assert(it->first=="a\n" && !it->second);
+    ++it;
+    assert(it->first=="bc\n" && it->second);
+    ++it;
+    assert(it->first=="d" && !it->second);
+    history.append_to_line(1, " done");
+    assert(history.get_lines(1, 1).front().first=="bc done");
+    
+    history.clear();
+    assert(history.first_line()==2);
+    assert(history.get_lines(0, 2).empty());
+  }
+  {
+    Terminal::History history;
+    history.max_lines=10;
+    for(size_t i=0;i<Terminal::History::chunk_size*3;++i)
+      history.append(std::to_string(i)+"\n", false);
+    assert(history.last_line()==Terminal::History::chunk_size*3);
+    assert(history.first_line()==Terminal::History::chunk_size*2);
+    assert(history.get_lines(0, history.first_line()).front().first==std::to_string(Terminal::History::chunk_size*2));
+  }
+  {
+    Config::get().terminal.history_size=1000;
+    Terminal::get().clear();
+    Terminal::get().print("~/t\u00e9st/test.cc:7:41: error: expected ';' after expression.\n");
+    auto buffer=Terminal::get().get_buffer();
+    assert(buffer->begin().has_tag(Terminal::get().link_tag));
+    assert(buffer->get_iter_at_offset(18).has_tag(Terminal::get().link_tag));
+    assert(!buffer->get_iter_at_offset(19).has_tag(Terminal::get().link_tag));
+  }
 }